@@ -0,0 +1,42 @@
+#ifndef DPCM_H
+#define DPCM_H
+
+#include <cstdint>
+#include <algorithm>
+
+// Closed-loop DPCM with the fixed polynomial predictors of order 0 to 3
+// (as in Shorten and FLAC). The prediction uses the last three reconstructed
+// samples h[0] = x[n-1], h[1] = x[n-2], h[2] = x[n-3], and the residual is
+// quantized with a uniform mid-tread quantizer of step "step" (1 = lossless).
+struct DPCM {
+	static constexpr int MAX_ORDER = 3;
+
+	static int predict(int order, const int* h) {
+		int p;
+		switch(order) {
+			case 1: p = h[0]; break;
+			case 2: p = 2 * h[0] - h[1]; break;
+			case 3: p = 3 * h[0] - 3 * h[1] + h[2]; break;
+			default: p = 0;
+		}
+		return std::clamp(p, -32768, 32767);
+	}
+
+	// Residual index, rounded to the nearest multiple of the step
+	static int quantize(int e, int step) {
+		return e >= 0 ? (e + step / 2) / step : -((-e + step / 2) / step);
+	}
+
+	static int reconstruct(int prediction, int q, int step) {
+		return std::clamp(prediction + q * step, -32768, 32767);
+	}
+
+	// Shifts the reconstructed sample "x" into the history
+	static void push(int* h, int x) {
+		h[2] = h[1];
+		h[1] = h[0];
+		h[0] = x;
+	}
+};
+
+#endif
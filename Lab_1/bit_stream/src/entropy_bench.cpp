@@ -0,0 +1,159 @@
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <random>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <functional>
+#include <fstream>
+#include <filesystem>
+#include "bit_pack.h"
+#include "huffman.h"
+#include "rans.h"
+#include "bit_stream.h"
+#include "rice.h"
+
+using namespace std;
+
+// Débito dos codificadores entrópicos sobre índices sintéticos: distribuição
+// geométrica bilateral centrada no nível do meio, como a dos índices do
+// wav_quant_enc em áudio real
+
+static double seconds(const function<void()>& f) {
+    auto t0 = chrono::steady_clock::now();
+    f();
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+}
+
+static void report(const string& name, size_t n, size_t bytes, double t_enc, double t_dec, bool ok) {
+    cout << left << setw(12) << name << right << fixed << setprecision(3)
+         << setw(10) << bytes * 8.0 / n
+         << setw(14) << setprecision(1) << n / t_enc / 1e6
+         << setw(14) << n / t_dec / 1e6
+         << (ok ? "" : "   MISMATCH") << endl;
+}
+
+int main(int argc, char* argv[]) {
+    size_t n = 10000000;
+    int bits = 8;
+    double spread = 8;
+    for (int i = 1; i < argc; i++) {
+        if (string(argv[i]) == "-n" && i + 1 < argc)
+            n = stoul(argv[++i]);
+        else if (string(argv[i]) == "-bits" && i + 1 < argc)
+            bits = stoi(argv[++i]);
+        else if (string(argv[i]) == "-spread" && i + 1 < argc)
+            spread = stod(argv[++i]);
+        else {
+            cerr << "Usage: " << argv[0] << " [ -n symbols (def 10000000) ] [ -bits alphabetBits (def 8) ]\n";
+            cerr << "       [ -spread meanDistanceFromMiddle (def 8) ]\n";
+            return 1;
+        }
+    }
+    if (bits < 1 || bits > 16) {
+        cerr << "Invalid alphabet size (must be 1-16 bits)\n";
+        return 1;
+    }
+
+    const uint32_t levels = 1u << bits, half = levels / 2;
+    mt19937 rng(1);
+    geometric_distribution<int> dist(1.0 / (spread + 1));
+    vector<uint16_t> symbols(n);
+    vector<size_t> counts(levels);
+    for (uint16_t& s : symbols) {
+        int d = dist(rng);
+        int v = (rng() & 1) ? half + d : static_cast<int>(half) - 1 - d;
+        s = static_cast<uint16_t>(min<int>(max(v, 0), levels - 1));
+        counts[s]++;
+    }
+
+    cout << "Symbols: " << n << ", alphabet: " << levels << endl;
+    cout << left << setw(12) << "coder" << right << setw(10) << "bits/sym"
+         << setw(14) << "enc Msym/s" << setw(14) << "dec Msym/s" << endl;
+
+    // Largura fixa (referência)
+    {
+        BitPacker packer;
+        vector<uint16_t> out(n);
+        double t_enc = seconds([&] { packer.pack(symbols.data(), n, bits); packer.finish(); });
+        double t_dec = seconds([&] { BitUnpacker u(packer.data(), packer.size()); u.unpack(out.data(), n, bits); });
+        report("fixed", n, packer.size(), t_enc, t_dec, out == symbols);
+    }
+
+    // Huffman canónico
+    {
+        BitPacker packer;
+        vector<uint16_t> out(n);
+        double t_enc = seconds([&] {
+            Huffman code = Huffman::from_histogram(counts);
+            code.write(packer);
+            for (uint16_t s : symbols)
+                code.encode(packer, s);
+            packer.finish();
+        });
+        double t_dec = seconds([&] {
+            BitUnpacker u(packer.data(), packer.size());
+            Huffman code;
+            string error;
+            Huffman::read(u, code, error);
+            for (uint16_t& s : out)
+                s = static_cast<uint16_t>(code.decode(u));
+        });
+        report("huffman", n, packer.size(), t_enc, t_dec, out == symbols);
+    }
+
+    // rANS com N estados intercalados (tabela incluída no tamanho)
+    auto rans = [&]<int N>(const string& name) {
+        BitPacker packer;
+        vector<uint8_t> bytes;
+        vector<uint16_t> out(n);
+        double t_enc = seconds([&] {
+            RANSCode code = RANSCode::from_histogram(counts);
+            code.write(packer);
+            packer.finish();
+            bytes = code.encode<N>(symbols.data(), n);
+        });
+        double t_dec = seconds([&] {
+            BitUnpacker u(packer.data(), packer.size());
+            RANSCode code;
+            string error;
+            RANSCode::read(u, code, error);
+            code.decode<N>(bytes.data(), bytes.size(), out.data(), n);
+        });
+        report(name, n, packer.size() + bytes.size(), t_enc, t_dec, out == symbols);
+    };
+    rans.template operator()<4>("rans x4");
+    rans.template operator()<8>("rans x8");
+
+    // Rice sobre a distância ao nível do meio; usa o BitStream, como o
+    // wav_dpcm_enc e o wav_lossless_enc, logo passa por um ficheiro temporário
+    {
+        string path = (filesystem::temp_directory_path() / "entropy_bench.tmp").string();
+        uint64_t sum = 0;
+        for (uint16_t s : symbols)
+            sum += Rice::zigzag(static_cast<int32_t>(s) - static_cast<int32_t>(half));
+        int k = Rice::parameter(sum, n);
+        vector<uint16_t> out(n);
+        double t_enc = seconds([&] {
+            fstream fs(path, ios::binary | ios::out);
+            BitStream bs(fs, STREAM_WRITE);
+            for (uint16_t s : symbols)
+                Rice::write(bs, static_cast<int32_t>(s) - static_cast<int32_t>(half), k);
+            bs.close();
+        });
+        size_t bytes = filesystem::file_size(path);
+        double t_dec = seconds([&] {
+            fstream fs(path, ios::binary | ios::in);
+            BitStream bs(fs, STREAM_READ);
+            int32_t v;
+            for (uint16_t& s : out)
+                if (Rice::read(bs, k, v))
+                    s = static_cast<uint16_t>(v + static_cast<int32_t>(half));
+        });
+        filesystem::remove(path);
+        report("rice k=" + to_string(k), n, bytes, t_enc, t_dec, out == symbols);
+    }
+
+    return 0;
+}
@@ -0,0 +1,199 @@
+#ifndef LPC_H
+#define LPC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LPC_X86
+#endif
+
+// Linear prediction for the lossless codec. The encoder computes the
+// autocorrelation of a windowed block, runs Levinson-Durbin and quantizes
+// the coefficients to PRECISION bits with a common right shift:
+//   prediction(n) = (sum_j q[j] * x[n-1-j]) >> shift
+// With 16-bit samples, |q[j]| < 2^11 and order <= MAX_ORDER the sum always
+// fits in 32 bits, so encoder and decoder use plain int32 arithmetic and the
+// residual can be computed 8 samples at a time. The autocorrelation and
+// residual kernels use AVX2 when the running CPU supports it.
+class LPC {
+  public:
+	static constexpr int MAX_ORDER = 32;
+	static constexpr int PRECISION = 12;
+	static constexpr int MAX_SHIFT = 15;
+
+  private:
+	using AutocorrKernel = void (*)(const double*, size_t, int, double*);
+	using ResidualKernel = void (*)(const int32_t*, size_t, const int32_t*, int, int, int32_t*);
+
+	static void autocorr_scalar(const double* x, size_t n, int max_lag, double* r) {
+		for(int l = 0 ; l <= max_lag ; l++) {
+			double sum = 0;
+			for(size_t i = l ; i < n ; i++)
+				sum += x[i] * x[i - l];
+			r[l] = sum;
+		}
+	}
+
+	static void residual_scalar(const int32_t* x, size_t n, const int32_t* q, int order, int shift, int32_t* e) {
+		for(size_t i = order ; i < n ; i++) {
+			int32_t sum = 0;
+			for(int j = 0 ; j < order ; j++)
+				sum += q[j] * x[i - 1 - j];
+			e[i] = x[i] - (sum >> shift);
+		}
+	}
+
+#ifdef LPC_X86
+	__attribute__((target("avx2,fma")))
+	static void autocorr_avx2(const double* x, size_t n, int max_lag, double* r) {
+		for(int l = 0 ; l <= max_lag ; l++) {
+			__m256d acc0 = _mm256_setzero_pd();
+			__m256d acc1 = _mm256_setzero_pd();
+			size_t i = l;
+			for( ; i + 8 <= n ; i += 8) {
+				acc0 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i), _mm256_loadu_pd(x + i - l), acc0);
+				acc1 = _mm256_fmadd_pd(_mm256_loadu_pd(x + i + 4), _mm256_loadu_pd(x + i + 4 - l), acc1);
+			}
+			double lanes[4];
+			_mm256_storeu_pd(lanes, _mm256_add_pd(acc0, acc1));
+			double sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+			for( ; i < n ; i++)
+				sum += x[i] * x[i - l];
+			r[l] = sum;
+		}
+	}
+
+	__attribute__((target("avx2")))
+	static void residual_avx2(const int32_t* x, size_t n, const int32_t* q, int order, int shift, int32_t* e) {
+		const __m128i sh = _mm_cvtsi32_si128(shift);
+		size_t i = order;
+		for( ; i + 8 <= n ; i += 8) {
+			__m256i sum = _mm256_setzero_si256();
+			for(int j = 0 ; j < order ; j++) {
+				__m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i - 1 - j));
+				sum = _mm256_add_epi32(sum, _mm256_mullo_epi32(xv, _mm256_set1_epi32(q[j])));
+			}
+			__m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(e + i), _mm256_sub_epi32(xv, _mm256_sra_epi32(sum, sh)));
+		}
+		// Remaining samples
+		for( ; i < n ; i++) {
+			int32_t sum = 0;
+			for(int j = 0 ; j < order ; j++)
+				sum += q[j] * x[i - 1 - j];
+			e[i] = x[i] - (sum >> shift);
+		}
+	}
+#endif
+
+	static bool has_avx2() {
+#ifdef LPC_X86
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#else
+		return false;
+#endif
+	}
+
+  public:
+	// Autocorrelation r[0..max_lag] of the block after a Welch window
+	static void autocorrelation(const int32_t* x, size_t n, int max_lag, double* r) {
+		static const AutocorrKernel kernel = [] {
+#ifdef LPC_X86
+			if(has_avx2())
+				return static_cast<AutocorrKernel>(autocorr_avx2);
+#endif
+			return static_cast<AutocorrKernel>(autocorr_scalar);
+		}();
+
+		std::vector<double> xw(n);
+		const double half = (n - 1) / 2.0, den = (n + 1) / 2.0;
+		for(size_t i = 0 ; i < n ; i++) {
+			double t = (i - half) / den;
+			xw[i] = x[i] * (1 - t * t);
+		}
+		std::fill(r, r + max_lag + 1, 0.0);
+		if(n > static_cast<size_t>(max_lag))
+			kernel(xw.data(), n, max_lag, r);
+	}
+
+	// Levinson-Durbin recursion: lpc[p-1][0..p-1] are the predictor coefficients of
+	// order p (prediction = sum_j lpc[j] * x[n-1-j]) and err[p] the prediction
+	// error energy, for p up to max_order (lower if the recursion becomes unstable).
+	// Returns the highest order computed.
+	static int levinson(const double* r, int max_order, std::vector<std::vector<double>>& lpc, std::vector<double>& err) {
+		lpc.assign(max_order, { });
+		err.assign(max_order + 1, 0.0);
+		err[0] = r[0];
+		std::vector<double> a, prev;
+		for(int p = 1 ; p <= max_order ; p++) {
+			if(err[p - 1] <= 0)
+				return p - 1;
+			double acc = r[p];
+			for(int j = 0 ; j < p - 1 ; j++)
+				acc -= a[j] * r[p - 1 - j];
+			double k = acc / err[p - 1];
+			prev = a;
+			a.resize(p);
+			a[p - 1] = k;
+			for(int j = 0 ; j < p - 1 ; j++)
+				a[j] = prev[j] - k * prev[p - 2 - j];
+			err[p] = err[p - 1] * (1 - k * k);
+			lpc[p - 1] = a;
+		}
+		return max_order;
+	}
+
+	// Quantizes "c" to PRECISION-bit integers with error feedback; returns the shift
+	static int quantize(const std::vector<double>& c, std::vector<int32_t>& q) {
+		const int32_t qmax = (1 << (PRECISION - 1)) - 1;
+		double cmax = 0;
+		for(double v : c)
+			cmax = std::max(cmax, std::fabs(v));
+
+		int shift = MAX_SHIFT;
+		if(cmax > 0) {
+			int e;
+			std::frexp(cmax, &e);	// cmax < 2^e
+			shift = std::clamp(PRECISION - 1 - e, 0, MAX_SHIFT);
+		}
+
+		q.resize(c.size());
+		double error = 0;
+		for(size_t j = 0 ; j < c.size() ; j++) {
+			error += c[j] * (1 << shift);
+			q[j] = std::clamp(static_cast<int32_t>(std::lround(error)), -qmax, qmax);
+			error -= q[j];
+		}
+		return shift;
+	}
+
+	// Residual e[order..n) of the block x[0..n); e[0..order) is left untouched
+	static void residual(const int32_t* x, size_t n, const int32_t* q, int order, int shift, int32_t* e) {
+		static const ResidualKernel kernel = [] {
+#ifdef LPC_X86
+			if(has_avx2())
+				return static_cast<ResidualKernel>(residual_avx2);
+#endif
+			return static_cast<ResidualKernel>(residual_scalar);
+		}();
+		kernel(x, n, q, order, shift, e);
+	}
+
+	// Inverse of residual(): x[0..order) must hold the warm-up samples
+	static void restore(const int32_t* e, size_t n, const int32_t* q, int order, int shift, int32_t* x) {
+		for(size_t i = order ; i < n ; i++) {
+			int32_t sum = 0;
+			for(int j = 0 ; j < order ; j++)
+				sum += q[j] * x[i - 1 - j];
+			x[i] = e[i] + (sum >> shift);
+		}
+	}
+};
+
+#endif
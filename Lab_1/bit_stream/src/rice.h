@@ -0,0 +1,154 @@
+#ifndef RICE_H
+#define RICE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "bit_stream.h"
+
+// Rice codes (Golomb codes with a power-of-two parameter 2^k) over BitStream.
+// Signed values are first mapped to unsigned ones by zig-zag (0, -1, 1, -2, ...).
+// A value u is written as u >> k in unary (ones ended by a zero) followed by
+// the k low bits of u. Quotients of ESCAPE or more are written as ESCAPE ones
+// followed by u in RAW_BITS bits, which bounds the length of any code word.
+class Rice {
+  public:
+	static constexpr int MAX_K = 31;
+	static constexpr uint32_t ESCAPE = 32;
+	static constexpr int RAW_BITS = 32;
+
+	static uint32_t zigzag(int32_t v) {
+		return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+	}
+
+	static int32_t unzigzag(uint32_t u) {
+		return static_cast<int32_t>(u >> 1) ^ -static_cast<int32_t>(u & 1);
+	}
+
+	// Parameter for "n" values whose zig-zag mapped sum is "sum" (k ~ log2 of the mean)
+	static int parameter(uint64_t sum, size_t n) {
+		int k = 0;
+		while(k < MAX_K && (static_cast<uint64_t>(n) << (k + 1)) <= sum)
+			k++;
+		return k;
+	}
+
+	// Length in bits of the code word of "v"
+	static uint64_t length(int32_t v, int k) {
+		uint32_t q = zigzag(v) >> k;
+		return q < ESCAPE ? q + 1 + k : ESCAPE + RAW_BITS;
+	}
+
+	static void write(BitStream& bs, int32_t v, int k) {
+		uint32_t u = zigzag(v);
+		uint32_t q = u >> k;
+		if(q < ESCAPE) {
+			for(uint32_t i = 0 ; i < q ; i++)
+				bs.write_bit(1);
+			bs.write_bit(0);
+			if(k > 0)
+				bs.write_n_bits(u & ((uint64_t { 1 } << k) - 1), k);
+		} else {
+			for(uint32_t i = 0 ; i < ESCAPE ; i++)
+				bs.write_bit(1);
+			bs.write_n_bits(u, RAW_BITS);
+		}
+	}
+
+	// Returns false if the stream ends before the code word does
+	static bool read(BitStream& bs, int k, int32_t& v) {
+		uint32_t q = 0;
+		int bit;
+		while(q < ESCAPE && (bit = bs.read_bit()) == 1)
+			q++;
+		if(q < ESCAPE && bit == EOF)
+			return false;
+
+		uint32_t u = 0;
+		int n = q < ESCAPE ? k : RAW_BITS;
+		for(int i = 0 ; i < n ; i++) {
+			if((bit = bs.read_bit()) == EOF)
+				return false;
+			u = (u << 1) | bit;
+		}
+		v = unzigzag(q < ESCAPE ? (q << k) | u : u);
+		return true;
+	}
+
+	// Partitioned coding: the "n" values are split into 2^p nearly equal
+	// partitions, partition i starting at (i * n) >> p, and each partition has
+	// its own parameter, written in 5 bits before its code words. The partition
+	// order p itself is written in 4 bits.
+	static constexpr int MAX_PARTITION_ORDER = 8;
+
+	static size_t partition_start(size_t n, int p, size_t i) {
+		return (i * n) >> p;
+	}
+
+	// Partition order (up to "max_p") with the smallest estimated length
+	static int partition_order(const int32_t* v, size_t n, int max_p = MAX_PARTITION_ORDER) {
+		while(max_p > 0 && (n >> max_p) == 0)
+			max_p--;
+
+		// Sums of the finest partitions; coarser ones merge pairs (the limits nest)
+		std::vector<uint64_t> sums(size_t { 1 } << max_p);
+		for(size_t i = 0 ; i < sums.size() ; i++)
+			for(size_t j = partition_start(n, max_p, i) ; j < partition_start(n, max_p, i + 1) ; j++)
+				sums[i] += zigzag(v[j]);
+
+		int best = max_p;
+		uint64_t best_bits = UINT64_MAX;
+		for(int p = max_p ; p >= 0 ; p--) {
+			uint64_t bits = 4;
+			for(size_t i = 0 ; i < sums.size() ; i++) {
+				size_t len = partition_start(n, p, i + 1) - partition_start(n, p, i);
+				int k = parameter(sums[i], len);
+				bits += 5 + len * (k + 1) + (sums[i] >> k);
+			}
+			if(bits < best_bits) {
+				best_bits = bits;
+				best = p;
+			}
+			for(size_t i = 0 ; i < sums.size() / 2 ; i++)
+				sums[i] = sums[2 * i] + sums[2 * i + 1];
+			sums.resize(sums.size() / 2);
+		}
+		return best;
+	}
+
+	static void write_partitioned(BitStream& bs, const int32_t* v, size_t n, int p) {
+		bs.write_n_bits(p, 4);
+		for(size_t i = 0 ; i < (size_t { 1 } << p) ; i++) {
+			size_t first = partition_start(n, p, i), last = partition_start(n, p, i + 1);
+			uint64_t sum = 0;
+			for(size_t j = first ; j < last ; j++)
+				sum += zigzag(v[j]);
+			int k = parameter(sum, last - first);
+			bs.write_n_bits(k, 5);
+			for(size_t j = first ; j < last ; j++)
+				write(bs, v[j], k);
+		}
+	}
+
+	// Returns false if the stream ends before the "n" values are read, or, with
+	// a message in "error", if the partition order is above MAX_PARTITION_ORDER
+	static bool read_partitioned(BitStream& bs, int32_t* v, size_t n, std::string& error) {
+		int p = static_cast<int>(bs.read_n_bits(4));	// -1 at the end of the file
+		if(p < 0)
+			return false;
+		if(p > MAX_PARTITION_ORDER) {
+			error = "invalid partition order " + std::to_string(p);
+			return false;
+		}
+		for(size_t i = 0 ; i < (size_t { 1 } << p) ; i++) {
+			int k = bs.read_n_bits(5);
+			for(size_t j = partition_start(n, p, i) ; j < partition_start(n, p, i + 1) ; j++)
+				if(not read(bs, k, v[j]))
+					return false;
+		}
+		return true;
+	}
+};
+
+#endif
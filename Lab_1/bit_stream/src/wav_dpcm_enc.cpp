@@ -0,0 +1,161 @@
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <span>
+#include "bit_stream.h"
+#include "wav_file.h"
+#include "rice.h"
+#include "dpcm.h"
+
+using namespace std;
+
+// Formato DPC1 (BitStream, MSB primeiro):
+//   "DPC1" (32) | sample rate (32) | canais (16) | frames (32) | passo (16) | frames por bloco (16)
+// e, para cada bloco e cada canal: ordem do preditor (2) | parâmetro Rice k (5) |
+// resíduos quantizados em código Rice. O histórico do preditor continua entre blocos.
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: " << argv[0] << " <input.wav> <output.bin> <step (1 = lossless)>\n";
+        cerr << "       [ -block frames (def 1024) ]\n";
+        return 1;
+    }
+
+    const char* input_wav_file = argv[1];
+    const char* output_bin_file = argv[2];
+    int step = stoi(argv[3]);
+
+    int block_frames = 1024;
+    for (int n = 4; n < argc; n++) {
+        if (string(argv[n]) == "-block" && n + 1 < argc)
+            block_frames = stoi(argv[++n]);
+    }
+
+    if (step < 1 || step > 65535) {
+        cerr << "Invalid quantization step (must be 1-65535)\n";
+        return 1;
+    }
+    if (block_frames < 1 || block_frames > 65535) {
+        cerr << "Invalid block size (must be 1-65535 frames)\n";
+        return 1;
+    }
+
+    WAVFile wav;
+    string error;
+    if (!wav.open(input_wav_file, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    if (wav.format() != 1 || wav.bits_per_sample() != 16) {
+        cerr << "Only 16-bit PCM WAV files are supported.\n";
+        return 1;
+    }
+
+    const uint16_t num_channels = wav.channels();
+    const size_t num_frames = wav.frames();
+    span<const int16_t> samples = wav.samples();
+
+    cout << "Sample rate: " << wav.sample_rate() << " Hz" << endl;
+    cout << "Channels: " << num_channels << endl;
+    cout << "Total frames: " << num_frames << endl;
+    cout << "Quantization step: " << step << endl;
+
+    fstream ofs(output_bin_file, ios::binary | ios::out);
+    if (!ofs) {
+        cerr << "Error opening output file: " << output_bin_file << endl;
+        return 1;
+    }
+
+    BitStream bs(ofs, STREAM_WRITE);
+    for (char c : string("DPC1"))
+        bs.write_n_bits(c, 8);
+    bs.write_n_bits(wav.sample_rate(), 32);
+    bs.write_n_bits(num_channels, 16);
+    bs.write_n_bits(num_frames, 32);
+    bs.write_n_bits(step, 16);
+    bs.write_n_bits(block_frames, 16);
+
+    // Histórico reconstruído de cada canal (igual ao do descodificador)
+    vector<int> history(num_channels * DPCM::MAX_ORDER, 0);
+    vector<int> residuals[DPCM::MAX_ORDER + 1];
+    int order_count[DPCM::MAX_ORDER + 1] { };
+    double signal_energy = 0, noise_energy = 0;
+
+    for (size_t first = 0; first < num_frames; first += block_frames) {
+        size_t n = min<size_t>(block_frames, num_frames - first);
+        for (int c = 0; c < num_channels; c++) {
+            const int16_t* x = samples.data() + first * num_channels + c;
+            int* h = history.data() + c * DPCM::MAX_ORDER;
+
+            // Experimentar os quatro preditores em malha fechada e escolher o de menor custo
+            int best = 0;
+            uint64_t best_bits = UINT64_MAX;
+            double best_noise = 0;
+            int best_h[DPCM::MAX_ORDER];
+            for (int order = 0; order <= DPCM::MAX_ORDER; order++) {
+                int th[DPCM::MAX_ORDER] = { h[0], h[1], h[2] };
+                vector<int>& res = residuals[order];
+                res.resize(n);
+                uint64_t sum = 0;
+                double noise = 0;
+                for (size_t i = 0; i < n; i++) {
+                    int p = DPCM::predict(order, th);
+                    int q = DPCM::quantize(x[i * num_channels] - p, step);
+                    int r = DPCM::reconstruct(p, q, step);
+                    res[i] = q;
+                    sum += Rice::zigzag(q);
+                    noise += double(x[i * num_channels] - r) * (x[i * num_channels] - r);
+                    DPCM::push(th, r);
+                }
+                int k = Rice::parameter(sum, n);
+                uint64_t bits = 0;
+                for (int q : res)
+                    bits += Rice::length(q, k);
+                if (bits < best_bits) {
+                    best_bits = bits;
+                    best = order;
+                    best_noise = noise;
+                    copy(th, th + DPCM::MAX_ORDER, best_h);
+                }
+            }
+
+            const vector<int>& res = residuals[best];
+            uint64_t sum = 0;
+            for (int q : res)
+                sum += Rice::zigzag(q);
+            int k = Rice::parameter(sum, n);
+            bs.write_n_bits(best, 2);
+            bs.write_n_bits(k, 5);
+            for (int q : res)
+                Rice::write(bs, q, k);
+            order_count[best]++;
+
+            copy(best_h, best_h + DPCM::MAX_ORDER, h);
+            noise_energy += best_noise;
+            for (size_t i = 0; i < n; i++)
+                signal_energy += double(x[i * num_channels]) * x[i * num_channels];
+        }
+    }
+
+    bs.close();
+
+    ifstream size_check(output_bin_file, ios::binary | ios::ate);
+    size_t file_size = size_check.tellg();
+    size_check.close();
+
+    cout << "\nEncoding complete!" << endl;
+    cout << "Output file: " << output_bin_file << endl;
+    cout << "File size: " << file_size << " bytes" << endl;
+    cout << "Bits per sample: " << file_size * 8.0 / max<size_t>(samples.size(), 1) << endl;
+    cout << "Predictor orders (0-3): " << order_count[0] << " " << order_count[1] << " "
+         << order_count[2] << " " << order_count[3] << endl;
+    if (noise_energy == 0)
+        cout << "SNR: inf (lossless)" << endl;
+    else
+        cout << "SNR: " << 10 * log10(signal_energy / noise_energy) << " dB" << endl;
+
+    return 0;
+}
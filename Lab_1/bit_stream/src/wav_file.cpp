@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "wav_file.h"
+
+using namespace std;
+
+static uint16_t get16(const uint8_t* p) {
+	return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t get32(const uint8_t* p) {
+	return get16(p) | (static_cast<uint32_t>(get16(p + 2)) << 16);
+}
+
+void WAVFile::unmap() {
+	if(m_map)
+		munmap(m_map, m_map_size);
+	m_map = nullptr;
+	m_map_size = 0;
+	m_data = nullptr;
+	m_data_size = 0;
+}
+
+bool WAVFile::open(const string& path, string& error) {
+	unmap();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		error = "cannot open " + path + ": " + strerror(errno);
+		return false;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) < 0 || st.st_size < 12) {
+		::close(fd);
+		error = "file too small to be a WAV file";
+		return false;
+	}
+
+	m_map_size = st.st_size;
+	void* map = mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(map == MAP_FAILED) {
+		m_map_size = 0;
+		error = "cannot map " + path + ": " + strerror(errno);
+		return false;
+	}
+	m_map = map;
+	madvise(m_map, m_map_size, MADV_SEQUENTIAL);
+
+	auto fail = [&](const char* msg) {
+		unmap();
+		error = msg;
+		return false;
+	};
+
+	const uint8_t* base = static_cast<const uint8_t*>(m_map);
+	const uint8_t* end = base + m_map_size;
+	if(memcmp(base, "RIFF", 4) != 0 || memcmp(base + 8, "WAVE", 4) != 0)
+		return fail("not a RIFF/WAVE file");
+
+	// Chunks are (id, size, payload), with the payload padded to an even size
+	bool has_fmt = false;
+	const uint8_t* p = base + 12;
+	while(end - p >= 8 and not (has_fmt and m_data)) {
+		const uint8_t* body = p + 8;
+		size_t size = get32(p + 4);
+		size_t avail = end - body;
+
+		if(memcmp(p, "fmt ", 4) == 0) {
+			if(size < 16 || size > avail)
+				return fail("invalid fmt chunk");
+			m_format = get16(body);
+			m_channels = get16(body + 2);
+			m_sample_rate = get32(body + 4);
+			m_bits_per_sample = get16(body + 14);
+			// WAVE_FORMAT_EXTENSIBLE: the real format is in the first two bytes of the subformat GUID
+			if(m_format == 0xFFFE && size >= 40)
+				m_format = get16(body + 24);
+			has_fmt = true;
+		} else if(memcmp(p, "data", 4) == 0) {
+			// A truncated file (or a streamed one, with size 0xFFFFFFFF) keeps what is there
+			m_data = body;
+			m_data_size = min(size, avail);
+		}
+
+		if(size + (size & 1) >= avail)
+			break;
+		p = body + size + (size & 1);
+	}
+
+	if(not has_fmt || not m_data)
+		return fail(has_fmt ? "no data chunk" : "no fmt chunk");
+	if(m_channels == 0)
+		return fail("invalid number of channels");
+	if(m_bits_per_sample == 0 || m_bits_per_sample % 8 != 0)
+		return fail("unsupported bits per sample");
+	if(reinterpret_cast<uintptr_t>(m_data) % alignof(int16_t) != 0)
+		return fail("misaligned data chunk");
+
+	return true;
+}
+
+bool WAVFile::write(const string& path, uint32_t sample_rate, uint16_t channels,
+  span<const int16_t> samples, string& error) {
+	ofstream ofs { path, ios::binary };
+	if(not ofs) {
+		error = "cannot create " + path;
+		return false;
+	}
+
+	uint8_t header[44];
+	uint32_t data_size = static_cast<uint32_t>(samples.size_bytes());
+	auto put16 = [&](int at, uint16_t v) { header[at] = v & 0xFF; header[at + 1] = v >> 8; };
+	auto put32 = [&](int at, uint32_t v) { put16(at, v & 0xFFFF); put16(at + 2, v >> 16); };
+	memcpy(header, "RIFF", 4);
+	put32(4, 36 + data_size);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put32(16, 16);
+	put16(20, 1);									// PCM
+	put16(22, channels);
+	put32(24, sample_rate);
+	put32(28, sample_rate * channels * 2);			// Byte rate
+	put16(32, static_cast<uint16_t>(channels * 2));	// Block align
+	put16(34, 16);
+	memcpy(header + 36, "data", 4);
+	put32(40, data_size);
+
+	ofs.write(reinterpret_cast<const char*>(header), sizeof header);
+	ofs.write(reinterpret_cast<const char*>(samples.data()), data_size);
+	if(not ofs) {
+		error = "error writing " + path;
+		return false;
+	}
+	return true;
+}
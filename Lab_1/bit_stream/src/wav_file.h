@@ -0,0 +1,58 @@
+#ifndef WAV_FILE_H
+#define WAV_FILE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <string>
+
+// Read-only view of a WAV file. The file is memory-mapped and its RIFF chunks
+// are walked to find "fmt " and "data", so extra chunks (LIST, fact, ...) and
+// WAVE_FORMAT_EXTENSIBLE headers are handled. The 16-bit samples are exposed
+// directly from the mapping, interleaved by channel, without being copied.
+class WAVFile {
+  private:
+	void*			m_map { nullptr };
+	size_t			m_map_size { };
+	uint16_t		m_format { };			// 1 = PCM (also for EXTENSIBLE with a PCM subformat)
+	uint16_t		m_channels { };
+	uint32_t		m_sample_rate { };
+	uint16_t		m_bits_per_sample { };
+	const uint8_t*	m_data { nullptr };
+	size_t			m_data_size { };
+
+	void unmap();
+
+  public:
+	WAVFile() = default;
+	~WAVFile() { unmap(); }
+
+	WAVFile(const WAVFile&) = delete;
+	WAVFile& operator=(const WAVFile&) = delete;
+
+	// Returns false, with a message in "error", if the file cannot be mapped
+	// or is not a valid WAV file
+	bool open(const std::string& path, std::string& error);
+
+	uint16_t format() const { return m_format; }
+	uint16_t channels() const { return m_channels; }
+	uint32_t sample_rate() const { return m_sample_rate; }
+	uint16_t bits_per_sample() const { return m_bits_per_sample; }
+
+	// Bytes of the data chunk (clamped to the end of the file if truncated)
+	size_t data_size() const { return m_data_size; }
+	size_t frames() const {
+		return m_channels ? m_data_size / (m_channels * size_t { m_bits_per_sample / 8u }) : 0;
+	}
+
+	// Only meaningful for 16-bit PCM; holds frames() * channels() samples
+	std::span<const int16_t> samples() const {
+		return { reinterpret_cast<const int16_t*>(m_data), frames() * m_channels };
+	}
+
+	// Writes interleaved 16-bit PCM samples as a canonical 44-byte header WAV file
+	static bool write(const std::string& path, uint32_t sample_rate, uint16_t channels,
+	  std::span<const int16_t> samples, std::string& error);
+};
+
+#endif
@@ -0,0 +1,122 @@
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <vector>
+#include <string>
+#include "bit_stream.h"
+#include "wav_file.h"
+#include "rice.h"
+#include "lpc.h"
+
+using namespace std;
+
+// Extensão de sinal de um valor de "bits" bits
+static int32_t sign_extend(uint64_t v, int bits) {
+    return static_cast<int32_t>(v << (32 - bits)) >> (32 - bits);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        cerr << "Usage: " << argv[0] << " <input.bin> <output.wav>\n";
+        return 1;
+    }
+
+    const char* input_bin_file = argv[1];
+    const char* output_wav_file = argv[2];
+
+    fstream ifs(input_bin_file, ios::binary | ios::in);
+    if (!ifs) {
+        cerr << "Error opening input file\n";
+        return 1;
+    }
+
+    BitStream bs(ifs, STREAM_READ);
+    string magic;
+    for (int i = 0; i < 4; i++)
+        magic += static_cast<char>(bs.read_n_bits(8));
+    if (magic != "LPC1") {
+        cerr << "Error: invalid file format (expected LPC1)\n";
+        return 1;
+    }
+
+    // Past the end of the file, read_n_bits returns all ones, above any field
+    bool eof = false;
+    auto field = [&](int bits) {
+        uint64_t v = bs.read_n_bits(bits);
+        eof = eof || (v >> bits) != 0;
+        return v;
+    };
+    uint32_t sample_rate = field(32);
+    uint16_t num_channels = field(16);
+    uint32_t num_frames = field(32);
+    size_t block_frames = field(16);
+
+    cout << "Sample rate: " << sample_rate << " Hz" << endl;
+    cout << "Channels: " << num_channels << endl;
+    cout << "Number of frames: " << num_frames << endl;
+
+    // Same limits as wav_quant_dec, before sizing the sample buffer
+    if (eof || num_channels == 0 || num_channels > 8 || num_frames > 1000000000 || block_frames == 0) {
+        cerr << "Error: invalid header\n";
+        return 1;
+    }
+
+    vector<int16_t> samples(static_cast<size_t>(num_frames) * num_channels);
+    vector<int32_t> x(block_frames), e(block_frames), coefs;
+    size_t frames_read = 0;
+    bool truncated = false;
+
+    for (size_t first = 0; first < num_frames && !truncated; first += block_frames) {
+        size_t n = min<size_t>(block_frames, num_frames - first);
+        for (int c = 0; c < num_channels && !truncated; c++) {
+            int order = bs.read_n_bits(6);
+            if (order > LPC::MAX_ORDER || static_cast<size_t>(order) >= n) {
+                cerr << "Error: invalid predictor order " << order << " at frame " << first << endl;
+                return 1;
+            }
+            int shift = 0;
+            coefs.resize(order);
+            if (order > 0) {
+                shift = bs.read_n_bits(4);
+                for (int32_t& q : coefs)
+                    q = sign_extend(bs.read_n_bits(LPC::PRECISION), LPC::PRECISION);
+            }
+            for (int i = 0; i < order; i++)
+                x[i] = sign_extend(bs.read_n_bits(16), 16);
+
+            string error;
+            if (!Rice::read_partitioned(bs, e.data() + order, n - order, error)) {
+                if (!error.empty()) {
+                    cerr << "Error: " << error << " at frame " << first << endl;
+                    return 1;
+                }
+                truncated = true;
+                break;
+            }
+            LPC::restore(e.data(), n, coefs.data(), order, shift, x.data());
+
+            int16_t* out = samples.data() + first * num_channels + c;
+            for (size_t i = 0; i < n; i++)
+                out[i * num_channels] = static_cast<int16_t>(x[i]);
+        }
+        if (!truncated)
+            frames_read += n;
+    }
+
+    bs.close();
+
+    if (truncated) {
+        cerr << "Unexpected end of file at frame " << frames_read << "/" << num_frames << endl;
+        samples.resize(frames_read * num_channels);
+    }
+    cout << "Decoded " << frames_read << " frames" << endl;
+
+    string error;
+    if (!WAVFile::write(output_wav_file, sample_rate, num_channels, samples, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+
+    cout << "Output: " << output_wav_file << endl;
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <iostream>
+#include <fstream>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <span>
+#include <thread>
+#include <atomic>
+#include "bit_stream.h"
+#include "wav_file.h"
+#include "rice.h"
+#include "lpc.h"
+
+using namespace std;
+
+// Formato LPC1 (BitStream, MSB primeiro):
+//   "LPC1" (32) | sample rate (32) | canais (16) | frames (32) | frames por bloco (16)
+// e, para cada bloco e cada canal (blocos independentes entre si):
+//   ordem (6) | [shift (4) | ordem coeficientes de 12 bits] | ordem amostras iniciais (16) |
+//   resíduos em código de Rice particionado (ver Rice::write_partitioned)
+
+// Resultado da análise de um canal de um bloco
+struct ChannelBlock {
+    int order = 0;
+    int shift = 0;
+    vector<int32_t> coefs;
+    vector<int32_t> x;          // Amostras (as primeiras "order" vão sem predição)
+    vector<int32_t> residual;   // Resíduo das amostras order..n-1
+    int partition_order = 0;
+};
+
+static void analyze(const int16_t* samples, size_t n, int num_channels, int c, int max_order, ChannelBlock& cb) {
+    cb.x.resize(n);
+    for (size_t i = 0; i < n; i++)
+        cb.x[i] = samples[i * num_channels + c];
+
+    // Escolher a ordem pela energia do erro de predição estimada pelo Levinson-Durbin
+    max_order = min<int>(max_order, n - 1);
+    vector<double> r(max_order + 1);
+    LPC::autocorrelation(cb.x.data(), n, max_order, r.data());
+    vector<vector<double>> lpc;
+    vector<double> err;
+    int top = LPC::levinson(r.data(), max_order, lpc, err);
+
+    cb.order = 0;
+    double best_bits = 0.5 * n * log2(max(err[0] / n, 1.0));
+    for (int p = 1; p <= top; p++) {
+        double bits = 0.5 * (n - p) * log2(max(err[p] / n, 1.0)) + p * (LPC::PRECISION + 16);
+        if (bits < best_bits) {
+            best_bits = bits;
+            cb.order = p;
+        }
+    }
+
+    vector<int32_t> e(n);
+    if (cb.order > 0) {
+        cb.shift = LPC::quantize(lpc[cb.order - 1], cb.coefs);
+        LPC::residual(cb.x.data(), n, cb.coefs.data(), cb.order, cb.shift, e.data());
+    } else {
+        cb.coefs.clear();
+        e = cb.x;
+    }
+    cb.residual.assign(e.begin() + cb.order, e.end());
+    cb.partition_order = Rice::partition_order(cb.residual.data(), cb.residual.size());
+}
+
+static void write_block(BitStream& bs, const ChannelBlock& cb) {
+    bs.write_n_bits(cb.order, 6);
+    if (cb.order > 0) {
+        bs.write_n_bits(cb.shift, 4);
+        for (int32_t q : cb.coefs)
+            bs.write_n_bits(static_cast<uint32_t>(q) & ((1u << LPC::PRECISION) - 1), LPC::PRECISION);
+    }
+    for (int i = 0; i < cb.order; i++)
+        bs.write_n_bits(static_cast<uint32_t>(cb.x[i]) & 0xFFFF, 16);
+    Rice::write_partitioned(bs, cb.residual.data(), cb.residual.size(), cb.partition_order);
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <input.wav> <output.bin>\n";
+        cerr << "       [ -block frames (def 4096) ] [ -order max (def 12, max 32) ] [ -j threads (def 1) ]\n";
+        return 1;
+    }
+
+    const char* input_wav_file = argv[1];
+    const char* output_bin_file = argv[2];
+
+    int block_frames = 4096;
+    int max_order = 12;
+    size_t n_jobs = 1;
+    int jobs = 1;
+    for (int n = 3; n < argc; n++) {
+        if (string(argv[n]) == "-block" && n + 1 < argc)
+            block_frames = stoi(argv[++n]);
+        else if (string(argv[n]) == "-order" && n + 1 < argc)
+            max_order = stoi(argv[++n]);
+        else if (string(argv[n]) == "-j" && n + 1 < argc)
+            jobs = atoi(argv[++n]);
+    }
+
+    if (block_frames < 1 || block_frames > 65535) {
+        cerr << "Invalid block size (must be 1-65535 frames)\n";
+        return 1;
+    }
+    if (max_order < 0 || max_order > LPC::MAX_ORDER) {
+        cerr << "Invalid predictor order (must be 0-" << LPC::MAX_ORDER << ")\n";
+        return 1;
+    }
+    if (jobs < 1) {
+        cerr << "Invalid number of threads (must be at least 1)\n";
+        return 1;
+    }
+    n_jobs = static_cast<size_t>(jobs);
+
+    WAVFile wav;
+    string error;
+    if (!wav.open(input_wav_file, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    if (wav.format() != 1 || wav.bits_per_sample() != 16) {
+        cerr << "Only 16-bit PCM WAV files are supported.\n";
+        return 1;
+    }
+
+    const uint16_t num_channels = wav.channels();
+    const size_t num_frames = wav.frames();
+    span<const int16_t> samples = wav.samples();
+
+    cout << "Sample rate: " << wav.sample_rate() << " Hz" << endl;
+    cout << "Channels: " << num_channels << endl;
+    cout << "Total frames: " << num_frames << endl;
+
+    fstream ofs(output_bin_file, ios::binary | ios::out);
+    if (!ofs) {
+        cerr << "Error opening output file: " << output_bin_file << endl;
+        return 1;
+    }
+
+    BitStream bs(ofs, STREAM_WRITE);
+    for (char c : string("LPC1"))
+        bs.write_n_bits(c, 8);
+    bs.write_n_bits(wav.sample_rate(), 32);
+    bs.write_n_bits(num_channels, 16);
+    bs.write_n_bits(num_frames, 32);
+    bs.write_n_bits(block_frames, 16);
+
+    // Os blocos são analisados em paralelo (por grupos, para limitar a memória)
+    // e escritos por ordem no BitStream
+    const size_t n_blocks = (num_frames + block_frames - 1) / block_frames;
+    const size_t group = n_jobs * 16;
+    vector<ChannelBlock> analysis(group * num_channels);
+    uint64_t order_sum = 0;
+
+    for (size_t first_block = 0; first_block < n_blocks; first_block += group) {
+        size_t count = min(group, n_blocks - first_block);
+        atomic<size_t> next { 0 };
+        auto worker = [&] {
+            for (size_t t; (t = next++) < count * num_channels; ) {
+                size_t b = first_block + t / num_channels;
+                size_t n = min<size_t>(block_frames, num_frames - b * block_frames);
+                analyze(samples.data() + b * block_frames * num_channels, n, num_channels,
+                        t % num_channels, max_order, analysis[t]);
+            }
+        };
+        vector<thread> pool;
+        for (size_t j = 1; j < n_jobs; j++)
+            pool.emplace_back(worker);
+        worker();
+        for (thread& th : pool)
+            th.join();
+
+        for (size_t t = 0; t < count * num_channels; t++) {
+            write_block(bs, analysis[t]);
+            order_sum += analysis[t].order;
+        }
+    }
+
+    bs.close();
+
+    ifstream size_check(output_bin_file, ios::binary | ios::ate);
+    size_t file_size = size_check.tellg();
+    size_check.close();
+
+    cout << "\nEncoding complete!" << endl;
+    cout << "Output file: " << output_bin_file << endl;
+    cout << "File size: " << file_size << " bytes" << endl;
+    cout << "Bits per sample: " << file_size * 8.0 / max<size_t>(samples.size(), 1) << endl;
+    cout << "Average predictor order: " << order_sum / max<double>(n_blocks * num_channels, 1) << endl;
+    cout << "Compression ratio: " << (wav.data_size() * 100.0 / file_size) << "%" << endl;
+
+    return 0;
+}
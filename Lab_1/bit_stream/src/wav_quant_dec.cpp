@@ -2,15 +2,50 @@
 #include <fstream>
 #include <vector>
 #include <cstdint>
-#include "bit_stream.h"
+#include <string>
+#include <cstdlib>
+#include <thread>
+#include "bit_pack.h"
+#include "quantizer.h"
+#include "wq01.h"
+#include "huffman.h"
+#include "rans.h"
 
 using namespace std;
 
+// Desempacota "n" índices e converte-os em amostras pela tabela de reconstrução;
+// devolve o número de amostras obtidas (menos de "n" se os bytes acabarem)
+static size_t decode_indices(BitUnpacker& unpacker, size_t n, int bits, const vector<int16_t>& recon, int16_t* out) {
+    uint16_t indices[4096];
+    size_t done = 0;
+    while (done < n) {
+        size_t m = unpacker.unpack(indices, min(n - done, size_t { 4096 }), bits);
+        for (size_t j = 0; j < m; ++j)
+            out[done + j] = recon[indices[j]];
+        done += m;
+        if (m == 0)
+            break;
+    }
+    return done;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " <input.bin> <output.wav>\n";
+    if (argc < 3) {
+        cerr << "Usage: " << argv[0] << " <input.bin> <output.wav> [ -j threads (def 1) ]\n";
+        return 1;
+    }
+
+    size_t n_jobs = 1;
+    int jobs = 1;
+    for (int n = 3; n < argc; n++) {
+        if (string(argv[n]) == "-j" && n + 1 < argc)
+            jobs = atoi(argv[++n]);
+    }
+    if (jobs < 1) {
+        cerr << "Invalid number of threads (must be at least 1)\n";
         return 1;
     }
+    n_jobs = static_cast<size_t>(jobs);
 
     const char* input_bin_file = argv[1];
     const char* output_wav_file = argv[2];
@@ -36,35 +71,24 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    char magic[5] = {0};
-    ifs.read(magic, 4);
-    
-    cout << "Magic: " << magic << endl;
-    
-    if (string(magic, 4) != "WQ01") {
-        cerr << "Invalid file format (expected WQ01, got " << magic << ")\n";
+    WQ01Header header;
+    string error;
+    if (!header.read(ifs, error)) {
+        cerr << "Error: " << error << endl;
         return 1;
     }
 
-    uint32_t sample_rate, num_samples;
-    uint16_t num_channels;
-    uint8_t quant_bits;
-    
-    ifs.read(reinterpret_cast<char*>(&sample_rate), 4);
-    ifs.read(reinterpret_cast<char*>(&num_channels), 2);
-    ifs.read(reinterpret_cast<char*>(&quant_bits), 1);
-    ifs.read(reinterpret_cast<char*>(&num_samples), 4);
+    uint32_t sample_rate = header.sample_rate;
+    uint32_t num_samples = header.num_frames;
+    uint16_t num_channels = header.num_channels;
+    uint8_t quant_bits = header.quant_bits;
 
     cout << "Sample rate: " << sample_rate << " Hz" << endl;
     cout << "Channels: " << num_channels << endl;
     cout << "Quantization bits: " << (int)quant_bits << endl;
+    cout << "Quantization mode: " << quant_mode_name(header.mode) << endl;
     cout << "Number of frames: " << num_samples << endl;
 
-    if (quant_bits == 0 || quant_bits > 16) {
-        cerr << "Invalid quantization bits: " << (int)quant_bits << endl;
-        return 1;
-    }
-    
     if (num_channels == 0 || num_channels > 8) {
         cerr << "Invalid number of channels: " << num_channels << endl;
         return 1;
@@ -79,57 +103,171 @@ int main(int argc, char* argv[]) {
     size_t total_samples = (size_t)num_samples * (size_t)num_channels;
     size_t expected_bits = total_samples * quant_bits;
     size_t expected_data_bytes = (expected_bits + 7) / 8;
-    size_t expected_total_size = 15 + expected_data_bytes;
+    size_t expected_total_size = header.size() + expected_data_bytes;
     
-    cout << "Expected file size: ~" << expected_total_size << " bytes" << endl;
+    if (header.block_frames)
+        cout << "Block size: " << header.block_frames << " frames" << endl;
+    else if (header.coder == WQ01Coder::HUFFMAN)
+        cout << "Entropy coder: Huffman" << endl;
+    else if (header.coder == WQ01Coder::RANS)
+        cout << "Entropy coder: rANS" << endl;
+    else
+        cout << "Expected file size: ~" << expected_total_size << " bytes" << endl;
     cout << "Actual file size: " << file_size << " bytes" << endl;
     
-    if (file_size < expected_total_size - 10) {
+    if (!header.extended() && file_size < expected_total_size - 10) {
         cerr << "Warning: File seems truncated!" << endl;
     }
 
-    // Inicializar BitStream para leitura
-    cout << "Initializing BitStream..." << endl;
-    BitStream bs(ifs, STREAM_READ);
+    // Tabela de reconstrução: índice -> amostra (tem 2^quant_bits entradas,
+    // por isso qualquer índice lido é válido)
+    vector<int16_t> recon = header.reconstruction_table();
 
-    const int levels = 1 << quant_bits;
-    vector<int16_t> samples;
-    samples.reserve(total_samples);
+    vector<int16_t> samples(total_samples);
 
     cout << "Decoding " << total_samples << " samples..." << endl;
 
     size_t samples_read = 0;
-    size_t progress_step = total_samples / 10;
-    if (progress_step == 0) progress_step = 1;
+    if (header.coder == WQ01Coder::HUFFMAN) {
+        // Huffman: tabela do código seguida dos códigos dos índices
+        vector<uint8_t> payload(file_size > header.size() ? file_size - header.size() : 0);
+        ifs.read(reinterpret_cast<char*>(payload.data()), payload.size());
+        BitUnpacker unpacker(payload.data(), ifs.gcount());
 
-    for (size_t i = 0; i < total_samples; ++i) {
-        if (ifs.eof() || !ifs.good()) {
-            cerr << "\nUnexpected end of file at sample " << i << "/" << total_samples << endl;
-            break;
+        Huffman code;
+        if (!Huffman::read(unpacker, code, error) || code.symbols() != recon.size()) {
+            cerr << "Error: " << (error.empty() ? "Huffman table does not match the header" : error) << endl;
+            return 1;
+        }
+        for (; samples_read < total_samples; samples_read++) {
+            uint32_t q = code.decode(unpacker);
+            if (q == Huffman::INVALID) {
+                cerr << "Error: invalid Huffman code at sample " << samples_read << endl;
+                return 1;
+            }
+            if (unpacker.overrun())
+                break;
+            samples[samples_read] = recon[q];
+        }
+        if (samples_read < total_samples)
+            cerr << "Unexpected end of file at sample " << samples_read << "/" << total_samples << endl;
+    } else if (header.coder == WQ01Coder::RANS) {
+        // rANS: tabela de frequências seguida do fluxo de bytes dos índices
+        vector<uint8_t> payload(file_size > header.size() ? file_size - header.size() : 0);
+        ifs.read(reinterpret_cast<char*>(payload.data()), payload.size());
+        vector<uint16_t> indices(total_samples);
+        size_t end = 0;
+        samples_read = RANSCode::read_stream(payload.data(), ifs.gcount(), recon.size(), indices.data(), total_samples, end, error);
+        if (!error.empty()) {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+        for (size_t i = 0; i < samples_read; i++)
+            samples[i] = recon[indices[i]];
+        if (samples_read < total_samples)
+            cerr << "Unexpected end of file at sample " << samples_read << "/" << total_samples << endl;
+    } else if (header.block_frames) {
+        // Modo por blocos: ler o payload, localizar os registos pela largura de
+        // cada um e descodificá-los (em paralelo, com -j)
+        vector<uint8_t> payload(file_size > header.size() ? file_size - header.size() : 0);
+        ifs.read(reinterpret_cast<char*>(payload.data()), payload.size());
+        size_t got = ifs.gcount();
+
+        const size_t block = header.block_samples();
+        vector<size_t> offsets;
+        size_t offset = 0;
+        for (size_t first = 0; first < total_samples; first += block) {
+            size_t n = min(block, total_samples - first);
+            if (offset >= got || offset + WQ01Block::size(n, payload[offset]) > got)
+                break;
+            if (payload[offset] > quant_bits) {
+                cerr << "Error: invalid block width " << (int)payload[offset] << " at block " << offsets.size() << endl;
+                return 1;
+            }
+            offsets.push_back(offset);
+            offset += WQ01Block::size(n, payload[offset]);
         }
 
-        int q_index = bs.read_n_bits(quant_bits);
-        
-        if (q_index < 0 || q_index >= levels) {
-            cerr << "\nInvalid quantization index at sample " << i << ": " << q_index << endl;
-            q_index = (q_index < 0) ? 0 : (levels - 1);
+        size_t n_blocks = offsets.size();
+        size_t step = max<size_t>((n_blocks + n_jobs - 1) / n_jobs, 1);
+        auto decode_blocks = [&](size_t first_block, size_t last_block) {
+            vector<uint16_t> indices(block);
+            for (size_t b = first_block; b < last_block; b++) {
+                size_t n = min(block, total_samples - b * block);
+                WQ01Block::unpack(payload.data() + offsets[b], n, quant_bits, indices.data());
+                int16_t* out = samples.data() + b * block;
+                for (size_t j = 0; j < n; ++j)
+                    out[j] = recon[indices[j]];
+            }
+        };
+        vector<thread> pool;
+        for (size_t b = step; b < n_blocks; b += step)
+            pool.emplace_back(decode_blocks, b, min(b + step, n_blocks));
+        decode_blocks(0, min(step, n_blocks));
+        for (thread& t : pool)
+            t.join();
+
+        samples_read = min(n_blocks * block, total_samples);
+        if (samples_read < total_samples)
+            cerr << "Unexpected end of file at sample " << samples_read << "/" << total_samples << endl;
+    } else if (n_jobs > 1) {
+        // Ler o payload inteiro e dividi-lo em blocos alinhados ao byte, um por thread
+        vector<uint8_t> payload(expected_data_bytes);
+        ifs.read(reinterpret_cast<char*>(payload.data()), expected_data_bytes);
+        size_t got = ifs.gcount();
+
+        vector<size_t> limits = byte_aligned_chunks(total_samples, quant_bits, n_jobs);
+        vector<size_t> decoded(limits.size() - 1);
+        auto decode_chunk = [&](size_t c) {
+            size_t first_byte = min(limits[c] * quant_bits / 8, got);
+            size_t last_byte = min((limits[c + 1] * quant_bits + 7) / 8, got);
+            BitUnpacker unpacker(payload.data() + first_byte, last_byte - first_byte);
+            decoded[c] = decode_indices(unpacker, limits[c + 1] - limits[c], quant_bits, recon, samples.data() + limits[c]);
+        };
+        vector<thread> pool;
+        for (size_t c = 1; c < decoded.size(); c++)
+            pool.emplace_back(decode_chunk, c);
+        decode_chunk(0);
+        for (thread& t : pool)
+            t.join();
+
+        // Só o prefixo contíguo de amostras descodificadas é válido
+        for (size_t c = 0; c < decoded.size(); c++) {
+            samples_read += decoded[c];
+            if (decoded[c] < limits[c + 1] - limits[c])
+                break;
+        }
+        if (got < expected_data_bytes)
+            cerr << "Unexpected end of file at sample " << samples_read << "/" << total_samples << endl;
+    } else {
+        // Os índices são lidos em lotes de BATCH amostras; BATCH é múltiplo de 8,
+        // logo cada lote começa num byte inteiro e o truncamento deteta-se pelo
+        // número de bytes efetivamente lidos
+        const size_t BATCH = 1 << 16;
+        vector<uint8_t> bytes(BATCH * quant_bits / 8);
+        while (samples_read < total_samples) {
+            size_t n = min(BATCH, total_samples - samples_read);
+            size_t n_bytes = (n * quant_bits + 7) / 8;
+            ifs.read(reinterpret_cast<char*>(bytes.data()), n_bytes);
+            size_t got = ifs.gcount();
+
+            BitUnpacker unpacker(bytes.data(), got);
+            samples_read += decode_indices(unpacker, n, quant_bits, recon, samples.data() + samples_read);
+
+            if (got < n_bytes) {
+                cerr << "Unexpected end of file at sample " << samples_read << "/" << total_samples << endl;
+                break;
+            }
         }
-        
-        float normalized = (q_index + 0.5f) / levels;
-        int16_t sample = static_cast<int16_t>(normalized * 65536.0f - 32768.0f);
-        samples.push_back(sample);
-        
-        samples_read++;
-        
     }
 
     cout << "Decoded " << samples_read << " samples" << endl;
 
-    bs.close();
     ifs.close();
 
     if (samples_read != total_samples) {
         cerr << "Warning: Expected " << total_samples << " samples, but got " << samples_read << endl;
+        samples.resize(samples_read);
     }
 
     cout << "Writing WAV file: " << output_wav_file << endl;
@@ -2,60 +2,217 @@
 #include <fstream>
 #include <cstdint>
 #include <vector>
-#include "bit_stream.h"
+#include <string>
+#include <cstdlib>
+#include <sstream>
+#include <span>
+#include <thread>
+#include "quantizer.h"
+#include "bit_pack.h"
+#include "wq01.h"
+#include "wav_file.h"
+#include "huffman.h"
+#include "rans.h"
 
 using namespace std;
 
 int main(int argc, char* argv[]) {
-    if (argc != 4) {
+    if (argc < 4) {
         cerr << "Usage: " << argv[0] << " <input.wav> <output.bin> <quant_bits>\n";
+        cerr << "       [ -mode midrise|midtread|trunc|lloyd (def midrise) ] [ -lut ]\n";
+        cerr << "       [ -train histogram.txt (lloyd: wav_hist output, def input file) ]\n";
+        cerr << "       [ -block frames (per-block width, def off) ] [ -huffman | -rans ] [ -j threads (def 1) ]\n";
         return 1;
     }
 
     const char* input_wav_file = argv[1];
     const char* output_bin_file = argv[2];
     int quant_bits = stoi(argv[3]);
+
+    QuantMode mode = QuantMode::MID_RISE;
+    bool use_lut = false;
+    const char* train_file = nullptr;
+    size_t n_jobs = 1;
+    int jobs = 1;
+    int block_frames = 0;
+    WQ01Coder coder = WQ01Coder::FIXED;
+    for (int n = 4; n < argc; n++) {
+        if (string(argv[n]) == "-mode" && n + 1 < argc) {
+            if (!parse_quant_mode(argv[++n], mode)) {
+                cerr << "Unknown quantization mode: " << argv[n] << endl;
+                return 1;
+            }
+        } else if (string(argv[n]) == "-lut") {
+            use_lut = true;
+        } else if (string(argv[n]) == "-train" && n + 1 < argc) {
+            train_file = argv[++n];
+        } else if (string(argv[n]) == "-j" && n + 1 < argc) {
+            jobs = atoi(argv[++n]);
+        } else if (string(argv[n]) == "-block" && n + 1 < argc) {
+            block_frames = stoi(argv[++n]);
+        } else if (string(argv[n]) == "-huffman" || string(argv[n]) == "-rans") {
+            WQ01Coder c = string(argv[n]) == "-huffman" ? WQ01Coder::HUFFMAN : WQ01Coder::RANS;
+            if (coder != WQ01Coder::FIXED && coder != c) {
+                cerr << "Options -huffman and -rans cannot be combined\n";
+                return 1;
+            }
+            coder = c;
+        }
+    }
     
+    if (jobs < 1) {
+        cerr << "Invalid number of threads (must be at least 1)\n";
+        return 1;
+    }
+    n_jobs = static_cast<size_t>(jobs);
+
     if (quant_bits <= 0 || quant_bits > 16) {
         cerr << "Invalid number of quantization bits (must be 1-16)\n";
         return 1;
     }
 
-    // Abrir ficheiro WAV
-    ifstream ifs(input_wav_file, ios::binary);
-    if (!ifs) {
-        cerr << "Error opening input file: " << input_wav_file << endl;
+    if (block_frames < 0 || block_frames > 65535) {
+        cerr << "Invalid block size (must be 1-65535 frames)\n";
         return 1;
     }
 
-    char header[44];
-    ifs.read(header, 44);
-    if (ifs.gcount() < 44) {
-        cerr << "Invalid WAV file.\n";
+    // Os códigos entrópicos usam um modelo de todo o ficheiro
+    const bool entropy = coder != WQ01Coder::FIXED;
+    if (block_frames && entropy) {
+        cerr << "Option -block cannot be combined with -huffman or -rans\n";
         return 1;
     }
 
-    uint32_t sample_rate = *reinterpret_cast<uint32_t*>(&header[24]);
-    uint16_t num_channels = *reinterpret_cast<uint16_t*>(&header[22]);
-    uint16_t bits_per_sample = *reinterpret_cast<uint16_t*>(&header[34]);
-    uint32_t data_size = *reinterpret_cast<uint32_t*>(&header[40]);
-    
-    if (bits_per_sample != 16) {
-        cerr << "Only 16-bit WAV files are supported.\n";
+    // Mapear o ficheiro WAV; as amostras são lidas diretamente do mapeamento
+    WAVFile wav;
+    string error;
+    if (!wav.open(input_wav_file, error)) {
+        cerr << "Error: " << error << endl;
         return 1;
     }
 
-    uint32_t num_samples = data_size / (sizeof(int16_t) * num_channels);
+    if (wav.format() != 1 || wav.bits_per_sample() != 16) {
+        cerr << "Only 16-bit PCM WAV files are supported.\n";
+        return 1;
+    }
+
+    uint32_t sample_rate = wav.sample_rate();
+    uint16_t num_channels = wav.channels();
+    uint32_t num_samples = wav.frames();
+    span<const int16_t> samples = wav.samples();
 
     cout << "Sample rate: " << sample_rate << " Hz" << endl;
     cout << "Channels: " << num_channels << endl;
     cout << "Total frames: " << num_samples << endl;
     cout << "Quantization bits: " << quant_bits << endl;
+    cout << "Quantization mode: " << quant_mode_name(mode) << endl;
+
+    WQ01Header wq_header;
+    wq_header.sample_rate = sample_rate;
+    wq_header.num_channels = num_channels;
+    wq_header.quant_bits = static_cast<uint8_t>(quant_bits);
+    wq_header.mode = mode;
+    wq_header.num_frames = num_samples;
+    wq_header.block_frames = static_cast<uint16_t>(block_frames);
+    wq_header.coder = coder;
+
+    // Quantizar e empacotar os índices numa só passagem pelas amostras. Com -j,
+    // cada thread empacota um bloco que começa num byte inteiro para o seu
+    // próprio buffer; a concatenação é igual ao fluxo sequencial
+    vector<size_t> limits;
+    if (block_frames) {
+        // Modo por blocos: cada registo WQ01Block já começa num byte inteiro
+        size_t block = wq_header.block_samples();
+        size_t n_blocks = (samples.size() + block - 1) / block;
+        size_t step = max<size_t>((n_blocks + n_jobs - 1) / n_jobs, 1) * block;
+        limits.push_back(0);
+        while (limits.back() < samples.size())
+            limits.push_back(min(limits.back() + step, samples.size()));
+        if (limits.size() == 1)
+            limits.push_back(0);
+    } else {
+        limits = byte_aligned_chunks(samples.size(), quant_bits, n_jobs);
+    }
+    vector<BitPacker> packers(limits.size() - 1);
+    vector<uint16_t> all_indices(entropy ? samples.size() : 0);
+    auto pack_chunk = [&](const auto& quantizer, size_t c) {
+        if (entropy) {
+            // Huffman/rANS: as threads só quantizam; o código é construído depois
+            quantizer.encode(samples.data() + limits[c], limits[c + 1] - limits[c], all_indices.data() + limits[c]);
+            return;
+        }
+        if (!block_frames) {
+            packers[c].quant_pack(quantizer, samples.data() + limits[c], limits[c + 1] - limits[c], quant_bits);
+            return;
+        }
+        vector<uint16_t> indices(wq_header.block_samples());
+        for (size_t i = limits[c]; i < limits[c + 1]; i += indices.size()) {
+            size_t n = min(indices.size(), limits[c + 1] - i);
+            quantizer.encode(samples.data() + i, n, indices.data());
+            WQ01Block::pack(packers[c], indices.data(), n, quant_bits);
+        }
+    };
+    auto quant_pack = [&](const auto& quantizer) {
+        vector<thread> pool;
+        for (size_t c = 1; c < packers.size(); c++)
+            pool.emplace_back([&, c] { pack_chunk(quantizer, c); });
+        pack_chunk(quantizer, 0);
+        for (thread& t : pool)
+            t.join();
+    };
+    if (mode == QuantMode::LLOYD_MAX) {
+        // Lloyd-Max: treinar o dicionário num histograma (do próprio ficheiro ou do wav_hist)
+        vector<size_t> hist(65536);
+        if (train_file) {
+            ifstream hfs(train_file);
+            if (!hfs) {
+                cerr << "Error opening histogram file: " << train_file << endl;
+                return 1;
+            }
+            string line;
+            while (getline(hfs, line)) {
+                long value;
+                size_t count;
+                istringstream iss(line);
+                if (line.empty() || line[0] == '#' || !(iss >> value >> count))
+                    continue;
+                if (value >= -32768 && value <= 32767)
+                    hist[value + 32768] += count;
+            }
+        } else {
+            for (int16_t s : samples)
+                hist[s + 32768]++;
+        }
+
+        LloydMaxQuantizer quantizer = LloydMaxQuantizer::train(hist, quant_bits);
+        wq_header.codebook = quantizer.codebook();
+        quant_pack(quantizer);
+        cout << "Codebook MSE (training histogram): " << quantizer.mse(hist) << endl;
+    } else {
+        // Quantizar (aritmética inteira)
+        UniformQuantizer quantizer(mode, quant_bits, use_lut);
+        quant_pack(quantizer);
+    }
 
-
-    vector<int16_t> samples(num_samples * num_channels);
-    ifs.read(reinterpret_cast<char*>(samples.data()), data_size);
-    ifs.close();
+    // Modelo estático construído a partir do histograma dos índices
+    vector<size_t> counts(entropy ? size_t { 1 } << quant_bits : 0);
+    for (uint16_t q : all_indices)
+        counts[q]++;
+    if (entropy)
+        packers.assign(1, BitPacker());
+    if (coder == WQ01Coder::RANS) {
+        RANSCode code = RANSCode::from_histogram(counts);
+        code.write_stream(packers[0], all_indices.data(), all_indices.size());
+        cout << "rANS code: " << packers[0].size() * 8.0 / max<double>(all_indices.size(), 1) << " bits/sample" << endl;
+    } else if (coder == WQ01Coder::HUFFMAN) {
+        // Código de Huffman canónico
+        Huffman code = Huffman::from_histogram(counts);
+        code.write(packers[0]);
+        for (uint16_t q : all_indices)
+            code.encode(packers[0], q);
+        cout << "Huffman code: " << code.cost(counts) / max<double>(all_indices.size(), 1) << " bits/sample" << endl;
+    }
+    packers.back().finish();
 
     ofstream ofs(output_bin_file, ios::binary);
     if (!ofs) {
@@ -63,53 +220,26 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-
-    ofs.write("WQ01", 4);                                      
-    ofs.write(reinterpret_cast<const char*>(&sample_rate), 4); 
-    ofs.write(reinterpret_cast<const char*>(&num_channels), 2);
-    uint8_t qbits = static_cast<uint8_t>(quant_bits);
-    ofs.write(reinterpret_cast<const char*>(&qbits), 1);       
-    ofs.write(reinterpret_cast<const char*>(&num_samples), 4); 
+    wq_header.write(ofs);
+    for (const BitPacker& packer : packers)
+        ofs.write(reinterpret_cast<const char*>(packer.data()), packer.size());
     ofs.close();
 
-    fstream fs(output_bin_file, ios::binary | ios::in | ios::out | ios::app);
-    if (!fs) {
-        cerr << "Error reopening output file for BitStream\n";
-        return 1;
-    }
-
-    BitStream bs(fs, STREAM_WRITE);
-
-    const int levels = 1 << quant_bits;
-
-    // Quantizar e escrever cada amostra
-    for (size_t i = 0; i < samples.size(); ++i) {
-        float normalized = (samples[i] + 32768.0f) / 65536.0f;
-        
-        int q_index = static_cast<int>(normalized * levels);
-        
-        if (q_index >= levels) q_index = levels - 1;
-        if (q_index < 0) q_index = 0;
-
-        bs.write_n_bits(q_index, quant_bits);
-    }
-
-    bs.close();
-    fs.close();
-
 
     ifstream size_check(output_bin_file, ios::binary | ios::ate);
     size_t file_size = size_check.tellg();
     size_check.close();
 
-    size_t expected_bits = samples.size() * quant_bits;
-    size_t expected_bytes = (expected_bits + 7) / 8 + 15; // +15 para o cabeçalho
+    size_t expected_bytes = wq_header.payload_size() + wq_header.size(); // + cabeçalho
 
     cout << "\nEncoding complete!" << endl;
     cout << "Output file: " << output_bin_file << endl;
     cout << "File size: " << file_size << " bytes" << endl;
-    cout << "Expected size: ~" << expected_bytes << " bytes" << endl;
-    cout << "Compression ratio: " << (data_size * 100.0 / file_size) << "%" << endl;
+    if (block_frames || entropy)
+        cout << "Fixed-width size: " << expected_bytes << " bytes" << endl;
+    else
+        cout << "Expected size: ~" << expected_bytes << " bytes" << endl;
+    cout << "Compression ratio: " << (wav.data_size() * 100.0 / file_size) << "%" << endl;
 
     return 0;
 }
\ No newline at end of file
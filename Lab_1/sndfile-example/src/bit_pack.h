@@ -0,0 +1,178 @@
+#ifndef BIT_PACK_H
+#define BIT_PACK_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include <numeric>
+
+// MSB-first bit packer into an in-memory byte buffer. The bytes produced are the
+// same as those of successive BitStream::write_n_bits calls followed by close(),
+// but whole blocks of values are packed at once through a 64-bit accumulator.
+class BitPacker {
+  private:
+	std::vector<uint8_t>	m_buf;
+	uint64_t				m_acc { };
+	int						m_nbits { };	// Pending bits in m_acc (always < 8 between calls)
+
+  public:
+	// Quantizes "n" samples with "q" (any quantizer with an encode() method) and
+	// packs the "bits"-wide indices. The indices go through a small buffer that
+	// stays in cache, so the samples are still traversed only once.
+	template<typename Quantizer>
+	void quant_pack(const Quantizer& q, const int16_t* samples, size_t n, int bits) {
+		constexpr size_t CHUNK = 1024;
+		uint16_t indices[CHUNK];
+		for(size_t i = 0 ; i < n ; i += CHUNK) {
+			size_t m = std::min(CHUNK, n - i);
+			q.encode(samples + i, m, indices);
+			pack(indices, m, bits);
+		}
+	}
+
+	// Appends a single value of "bits" (<= 32) bits, e.g. a variable-length code
+	void put(uint32_t value, int bits) {
+		m_acc = (m_acc << bits) | value;
+		m_nbits += bits;
+		while(m_nbits >= 8) {
+			m_nbits -= 8;
+			m_buf.push_back(static_cast<uint8_t>(m_acc >> m_nbits));
+		}
+	}
+
+	// Packs "n" already computed values of "bits" bits each
+	void pack(const uint16_t* values, size_t n, int bits) {
+		size_t used = m_buf.size();
+		m_buf.resize(used + (n * bits + m_nbits) / 8 + 1);
+		uint8_t* out = m_buf.data() + used;
+		uint64_t acc = m_acc;
+		int nbits = m_nbits;
+		for(size_t i = 0 ; i < n ; i++) {
+			acc = (acc << bits) | values[i];
+			nbits += bits;
+			while(nbits >= 8) {
+				nbits -= 8;
+				*out++ = static_cast<uint8_t>(acc >> nbits);
+			}
+		}
+		m_acc = acc;
+		m_nbits = nbits;
+		m_buf.resize(out - m_buf.data());
+	}
+
+	// Pads the pending bits with zeros up to a byte boundary
+	void finish() {
+		if(m_nbits > 0) {
+			m_buf.push_back(static_cast<uint8_t>(m_acc << (8 - m_nbits)));
+			m_nbits = 0;
+		}
+	}
+
+	// Appends whole bytes after finish(), e.g. the output of a byte-oriented coder
+	void append(const uint8_t* bytes, size_t n) {
+		m_buf.insert(m_buf.end(), bytes, bytes + n);
+	}
+
+	// Complete bytes packed so far; clear() drops them but keeps pending bits
+	const uint8_t* data() const { return m_buf.data(); }
+	size_t size() const { return m_buf.size(); }
+	void clear() { m_buf.clear(); }
+};
+
+// Reads back the MSB-first values written by BitPacker (or BitStream) from an
+// in-memory byte range, a block of values per call.
+class BitUnpacker {
+  private:
+	const uint8_t*	m_data;
+	size_t			m_size;
+	size_t			m_pos { };
+	uint64_t		m_acc { };
+	int				m_nbits { };	// Unread bits in m_acc
+	size_t			m_pad { };		// Zero bytes appended by peek() past the end
+
+  public:
+	BitUnpacker(const uint8_t* data, size_t size) : m_data { data }, m_size { size } { }
+
+	// Number of whole "bits"-wide values still available
+	size_t available(int bits) const {
+		if(overrun())
+			return 0;
+		return ((m_size - m_pos) * 8 + m_nbits - m_pad * 8) / bits;
+	}
+
+	// True once more bits were consumed than the data holds
+	bool overrun() const {
+		return static_cast<size_t>(m_nbits) < m_pad * 8;
+	}
+
+	// Next "n" (<= 32) bits, without consuming them; zeros past the end of the data
+	uint32_t peek(int n) {
+		while(m_nbits < n) {
+			uint8_t byte = 0;
+			if(m_pos < m_size)
+				byte = m_data[m_pos++];
+			else
+				m_pad++;
+			m_acc = (m_acc << 8) | byte;
+			m_nbits += 8;
+		}
+		return static_cast<uint32_t>((m_acc >> (m_nbits - n)) & ((uint64_t { 1 } << n) - 1));
+	}
+
+	// Consumes "n" bits, which must have been peeked
+	void skip(int n) {
+		m_nbits -= n;
+	}
+
+	uint32_t get(int n) {
+		uint32_t v = peek(n);
+		skip(n);
+		return v;
+	}
+
+	// Drops the unread bits of the current byte and returns the offset of the
+	// next byte, where data appended by BitPacker::append() begins
+	size_t align() {
+		m_nbits -= m_nbits % 8;
+		return std::min(m_pos + m_pad - m_nbits / 8, m_size);
+	}
+
+	// Unpacks up to "n" values of "bits" bits each; returns how many were
+	// unpacked, which is less than "n" only if the data runs out
+	size_t unpack(uint16_t* values, size_t n, int bits) {
+		n = std::min(n, available(bits));
+		const uint64_t mask = (uint64_t { 1 } << bits) - 1;
+		uint64_t acc = m_acc;
+		int nbits = m_nbits;
+		for(size_t i = 0 ; i < n ; i++) {
+			while(nbits < bits) {
+				acc = (acc << 8) | m_data[m_pos++];
+				nbits += 8;
+			}
+			nbits -= bits;
+			values[i] = static_cast<uint16_t>((acc >> nbits) & mask);
+		}
+		m_acc = acc;
+		m_nbits = nbits;
+		return n;
+	}
+};
+
+// Splits "n" values of "bits" bits each into at most "jobs" consecutive ranges
+// that start on byte boundaries of the packed stream, so that each range can be
+// packed or unpacked independently. Returns the range limits (first is 0, last
+// is "n").
+inline std::vector<size_t> byte_aligned_chunks(size_t n, int bits, size_t jobs) {
+	const size_t align = 8 / std::gcd(bits, 8);
+	size_t step = (n + std::max<size_t>(jobs, 1) - 1) / std::max<size_t>(jobs, 1);
+	step = std::max<size_t>((step + align - 1) / align * align, align);
+	std::vector<size_t> limits { 0 };
+	while(limits.back() < n)
+		limits.push_back(std::min(limits.back() + step, n));
+	if(n == 0)
+		limits.push_back(0);
+	return limits;
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef CABAC_H
+#define CABAC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+// Adaptive binary arithmetic coding (a range coder with byte-wise output, as
+// in LZMA). Every binary decision is coded with a BitModel, the estimated
+// probability of a 0 in units of 2^-PROB_BITS; after each decision the estimate
+// moves 1/2^ADAPT_SHIFT of the way towards the bit just coded, so the update is
+// a shift and the models follow the local statistics of the data. Bits that
+// are close to equiprobable are better coded in bypass mode, at exactly one bit.
+struct BitModel {
+	static constexpr int PROB_BITS = 12;
+	static constexpr int ADAPT_SHIFT = 5;
+
+	uint16_t	p { 1 << (PROB_BITS - 1) };
+
+	void update(int bit) {
+		if(bit)
+			p -= p >> ADAPT_SHIFT;
+		else
+			p += ((1 << PROB_BITS) - p) >> ADAPT_SHIFT;
+	}
+};
+
+class BinaryEncoder {
+  private:
+	static constexpr uint32_t TOP = 1u << 24;
+
+	std::vector<uint8_t>	m_out;
+	uint64_t				m_low { };
+	uint32_t				m_range { 0xFFFFFFFF };
+	uint8_t					m_cache { };
+	size_t					m_cache_size { 1 };	// Pending bytes (m_cache and 0xFF bytes) awaiting a carry
+
+	void shift_low() {
+		if(static_cast<uint32_t>(m_low) < 0xFF000000 || (m_low >> 32) != 0) {
+			uint8_t carry = static_cast<uint8_t>(m_low >> 32);
+			uint8_t byte = m_cache;
+			do {
+				m_out.push_back(static_cast<uint8_t>(byte + carry));
+				byte = 0xFF;
+			} while(--m_cache_size);
+			m_cache = static_cast<uint8_t>(m_low >> 24);
+		}
+		m_cache_size++;
+		m_low = (m_low & 0x00FFFFFF) << 8;
+	}
+
+  public:
+	void encode(BitModel& model, int bit) {
+		uint32_t bound = (m_range >> BitModel::PROB_BITS) * model.p;
+		if(bit) {
+			m_low += bound;
+			m_range -= bound;
+		} else {
+			m_range = bound;
+		}
+		model.update(bit);
+		while(m_range < TOP) {
+			m_range <<= 8;
+			shift_low();
+		}
+	}
+
+	// Codes a bit of probability 1/2 without a model (bypass)
+	void encode_bypass(int bit) {
+		m_range >>= 1;
+		if(bit)
+			m_low += m_range;
+		while(m_range < TOP) {
+			m_range <<= 8;
+			shift_low();
+		}
+	}
+
+	// Flushes the coder; the output is complete after this call
+	void finish() {
+		for(int i = 0 ; i < 5 ; i++)
+			shift_low();
+	}
+
+	const std::vector<uint8_t>& data() const { return m_out; }
+};
+
+class BinaryDecoder {
+  private:
+	static constexpr uint32_t TOP = 1u << 24;
+
+	const uint8_t*	m_data;
+	size_t			m_size;
+	size_t			m_pos { };
+	uint32_t		m_range { 0xFFFFFFFF };
+	uint32_t		m_code { };
+
+	uint8_t next() {
+		return m_pos < m_size ? m_data[m_pos++] : (m_pos++, 0);
+	}
+
+  public:
+	BinaryDecoder(const uint8_t* data, size_t size) : m_data { data }, m_size { size } {
+		for(int i = 0 ; i < 5 ; i++)
+			m_code = (m_code << 8) | next();
+	}
+
+	// True once the decoder needed bytes past the end of the data
+	bool overrun() const { return m_pos > m_size; }
+
+	int decode(BitModel& model) {
+		uint32_t bound = (m_range >> BitModel::PROB_BITS) * model.p;
+		int bit;
+		if(m_code < bound) {
+			m_range = bound;
+			bit = 0;
+		} else {
+			m_code -= bound;
+			m_range -= bound;
+			bit = 1;
+		}
+		model.update(bit);
+		while(m_range < TOP) {
+			m_range <<= 8;
+			m_code = (m_code << 8) | next();
+		}
+		return bit;
+	}
+
+	int decode_bypass() {
+		m_range >>= 1;
+		int bit = m_code >= m_range;
+		if(bit)
+			m_code -= m_range;
+		while(m_range < TOP) {
+			m_range <<= 8;
+			m_code = (m_code << 8) | next();
+		}
+		return bit;
+	}
+};
+
+#endif
@@ -0,0 +1,718 @@
+#ifndef DCT_CODEC_H
+#define DCT_CODEC_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "bit_stream.h"
+#include "bit_pack.h"
+#include "huffman.h"
+#include "rans.h"
+#include "cabac.h"
+
+// Entropy coding of the quantized coefficients of wav_dct_enc
+enum class DCTCoder : uint8_t { RAW = 0, HUFFMAN = 1, RANS = 2, CABAC = 3, EMBEDDED = 4 };
+
+// Transform of the blocks: non-overlapping DCT-II, or MDCT (frames of two
+// blocks with 50% overlap) with a sine or a Kaiser-Bessel derived window
+enum class DCTTransform : uint8_t { DCT = 0, MDCT_SINE = 1, MDCT_KBD = 2 };
+
+// Block switching: a block with a transient is coded as SHORT_BLOCKS short
+// DCTs of block_size / SHORT_BLOCKS samples, which keeps the pre-echo of its
+// quantization error close to the attack. The detector compares the energy of
+// each block_size / SHORT_BLOCKS samples with the mean energy of the
+// SHORT_BLOCKS segments before it. The short DCT coefficients are interleaved
+// (coefficient k of short block s at k * SHORT_BLOCKS + s), so that index i
+// is near the same frequency in long and short blocks; each short block keeps
+// coeffs / SHORT_BLOCKS coefficients and the rest of the block is zero.
+struct DCTSwitch {
+	static constexpr size_t SHORT_BLOCKS = 8;
+	static constexpr double RATIO = 10;			// Energy rise that marks a transient
+	static constexpr double MIN_ENERGY = 100;	// Per sample, below which nothing is a transient
+
+	// One flag per block of "bs" samples (samples.size() must be a multiple of bs)
+	template<typename Sample>
+	static std::vector<bool> detect(const std::vector<Sample>& samples, size_t bs) {
+		const size_t m = bs / SHORT_BLOCKS;
+		std::vector<bool> flags(samples.size() / bs, false);
+		std::vector<double> history(SHORT_BLOCKS, 0.0);
+		double sum = 0;
+		for(size_t seg = 0 ; seg * m < samples.size() ; seg++) {
+			double e = 0;
+			for(size_t j = seg * m ; j < (seg + 1) * m ; j++)
+				e += static_cast<double>(samples[j]) * samples[j];
+			if(e > RATIO * sum / SHORT_BLOCKS && e > MIN_ENERGY * m)
+				flags[seg / SHORT_BLOCKS] = true;
+			double& old = history[seg % SHORT_BLOCKS];
+			sum += e - old;
+			old = e;
+		}
+		return flags;
+	}
+
+	static void write(BitStream& bs, const std::vector<bool>& flags) {
+		for(bool f : flags)
+			bs.write_bit(f);
+	}
+
+	static std::vector<bool> read(BitStream& bs, size_t blocks) {
+		std::vector<bool> flags(blocks);
+		for(size_t n = 0 ; n < blocks ; n++)
+			flags[n] = bs.read_bit() == 1;
+		return flags;
+	}
+};
+
+// Header of the wav_dct_enc stream (BitStream, MSB first):
+//   sample rate (32) | block size (16) | coefficients per block (16) |
+//   ext << 7 | quantization bits (8) | frames (32)
+// With ext set, an extension byte follows with the DCTCoder in bits 0-2,
+// the DCTTransform in bits 3-4, the block switching flag in bit 5 and the
+// adaptive quantization flag in bit 6; with block switching, one bit per
+// block (DCTSwitch) comes next, then, with adaptive quantization, the
+// parameters of every block (DCTTarget).
+// RAW streams then hold every coefficient in "quantization bits" bits; the
+// EMBEDDED payload runs to the end of the file, so that the file can be cut
+// at any byte; the other coders store the byte count of their payload (32)
+// and the payload.
+struct DCTHeader {
+	uint32_t		sample_rate { };
+	size_t			block_size { };
+	size_t			coeffs { };
+	int				qbits { };
+	size_t			frames { };
+	DCTCoder		coder { DCTCoder::RAW };
+	DCTTransform	transform { DCTTransform::DCT };
+	bool			switching { false };
+	bool			adaptive { false };
+
+	bool mdct() const {
+		return transform != DCTTransform::DCT;
+	}
+
+	// Coefficient blocks in the stream: one per block of the signal, plus one
+	// with the MDCT, whose frames start a block before the signal
+	size_t blocks() const {
+		return (frames + block_size - 1) / block_size + (mdct() ? 1 : 0);
+	}
+
+	void write(BitStream& bs) const {
+		bool ext = coder != DCTCoder::RAW || mdct() || switching || adaptive;
+		bs.write_n_bits(sample_rate, 32);
+		bs.write_n_bits(block_size, 16);
+		bs.write_n_bits(coeffs, 16);
+		bs.write_n_bits(qbits | (ext ? 0x80 : 0), 8);
+		bs.write_n_bits(frames, 32);
+		if(ext)
+			bs.write_n_bits(static_cast<int>(coder) | (static_cast<int>(transform) << 3) | (switching ? 0x20 : 0) |
+			  (adaptive ? 0x40 : 0), 8);
+	}
+
+	bool read(BitStream& bs, std::string& error) {
+		sample_rate = static_cast<uint32_t>(bs.read_n_bits(32));
+		block_size = bs.read_n_bits(16);
+		coeffs = bs.read_n_bits(16);
+		int q = static_cast<int>(bs.read_n_bits(8));
+		frames = bs.read_n_bits(32);
+		qbits = q & 0x7F;
+		coder = DCTCoder::RAW;
+		transform = DCTTransform::DCT;
+		switching = false;
+		adaptive = false;
+		if(q & 0x80) {
+			int ext = static_cast<int>(bs.read_n_bits(8));
+			coder = static_cast<DCTCoder>(ext & 0x7);
+			transform = static_cast<DCTTransform>((ext >> 3) & 0x3);
+			switching = ext & 0x20;
+			adaptive = ext & 0x40;
+			if(coder > DCTCoder::EMBEDDED) {
+				error = "unknown entropy coder";
+				return false;
+			}
+			if(transform > DCTTransform::MDCT_KBD || (switching && mdct())) {
+				error = "unknown transform";
+				return false;
+			}
+		}
+		if(block_size == 0 || coeffs > block_size || (mdct() && block_size % 2) ||
+		  (switching && block_size % DCTSwitch::SHORT_BLOCKS)) {
+			error = "invalid block size";
+			return false;
+		}
+		return true;
+	}
+};
+
+// Variable-length representation of a coefficient v for the entropy coders:
+// its category c = number of bits of |v| (0 for v = 0), coded by the entropy
+// coder, then, for c > 0, the sign bit and the c - 1 bits of |v| below the
+// leading one, stored as they are.
+struct DCTCoef {
+	static constexpr int CATEGORIES = 34;
+
+	static int category(long v) {
+		unsigned long m = v < 0 ? -static_cast<unsigned long>(v) : v;
+		int c = 0;
+		while(m) {
+			c++;
+			m >>= 1;
+		}
+		return c;
+	}
+
+	static void put_extra(BitPacker& packer, long v, int c) {
+		if(c == 0)
+			return;
+		unsigned long m = v < 0 ? -static_cast<unsigned long>(v) : v;
+		packer.put(v < 0 ? 1 : 0, 1);
+		if(c > 1)
+			packer.put(static_cast<uint32_t>(m & ((1ul << (c - 1)) - 1)), c - 1);
+	}
+
+	static long get_extra(BitUnpacker& unpacker, int c) {
+		if(c == 0)
+			return 0;
+		bool negative = unpacker.get(1);
+		long m = (1l << (c - 1)) | (c > 1 ? unpacker.get(c - 1) : 0);
+		return negative ? -m : m;
+	}
+
+	// Huffman payload: code table over the categories, then the coefficients
+	static void write_huffman(BitPacker& packer, const std::vector<long>& coefs) {
+		std::vector<size_t> counts(CATEGORIES);
+		for(long v : coefs)
+			counts[category(v)]++;
+		Huffman code = Huffman::from_histogram(counts);
+		code.write(packer);
+		for(long v : coefs) {
+			int c = category(v);
+			code.encode(packer, c);
+			put_extra(packer, v, c);
+		}
+		packer.finish();
+	}
+
+	// Returns the number of coefficients read (less than "n" if the payload ends)
+	static size_t read_huffman(BitUnpacker& unpacker, size_t n, std::vector<long>& coefs, std::string& error) {
+		Huffman code;
+		if(not Huffman::read(unpacker, code, error))
+			return 0;
+		if(code.symbols() != CATEGORIES) {
+			error = "invalid coefficient code table";
+			return 0;
+		}
+		coefs.resize(n);
+		for(size_t i = 0 ; i < n ; i++) {
+			uint32_t c = code.decode(unpacker);
+			if(c == Huffman::INVALID) {
+				error = "invalid Huffman code in the payload";
+				return i;
+			}
+			coefs[i] = get_extra(unpacker, c);
+			if(unpacker.overrun())
+				return i;
+		}
+		return n;
+	}
+
+	// rANS payload: rANS stream of the categories, then the extra bits of all
+	// the coefficients
+	static void write_rans(BitPacker& packer, const std::vector<long>& coefs) {
+		std::vector<size_t> counts(CATEGORIES);
+		std::vector<uint8_t> categories(coefs.size());
+		for(size_t i = 0 ; i < coefs.size() ; i++)
+			counts[categories[i] = static_cast<uint8_t>(category(coefs[i]))]++;
+		RANSCode::from_histogram(counts).write_stream(packer, categories.data(), categories.size());
+		for(size_t i = 0 ; i < coefs.size() ; i++)
+			put_extra(packer, coefs[i], categories[i]);
+		packer.finish();
+	}
+
+	// Returns the number of coefficients read (less than "n" if the payload ends)
+	static size_t read_rans(const std::vector<uint8_t>& payload, size_t n, std::vector<long>& coefs, std::string& error) {
+		std::vector<uint8_t> categories(n);
+		size_t end = 0;
+		size_t m = RANSCode::read_stream(payload.data(), payload.size(), CATEGORIES, categories.data(), n, end, error);
+		BitUnpacker unpacker(payload.data() + end, payload.size() - end);
+		coefs.resize(n);
+		for(size_t i = 0 ; i < m ; i++) {
+			coefs[i] = get_extra(unpacker, categories[i]);
+			if(unpacker.overrun())
+				return i;
+		}
+		return m;
+	}
+};
+
+// Bit-plane coding of the coefficients with adaptive binary arithmetic coding
+// (CABAC payload). Each block of "coeffs" coefficients starts with its number
+// of bit planes, then goes from the most significant plane down: a coefficient
+// not yet significant gets a significance bit (and its sign when it becomes
+// significant), a significant one gets a refinement bit. The significance
+// contexts are the band of the coefficient and the magnitude, relative to the
+// plane, of its neighbours in the block and in the previous block; the first
+// refinement bits are coded with the band and their position as context, the
+// later ones and the signs in bypass mode.
+class DCTPlanes {
+  public:
+	static constexpr int BANDS = 12;
+	static constexpr int PLANE_BITS = 6;
+	static constexpr int LEVELS = 4;
+	static constexpr int DISTANCE = 2;
+	static constexpr int REFINEMENTS = 2;	// Refinement bits with a model; the rest are bypassed
+
+  private:
+	BitModel	m_planes[1 << PLANE_BITS];
+	BitModel	m_significance[BANDS][LEVELS][2 * DISTANCE + 1];
+	BitModel	m_refinement[BANDS][REFINEMENTS];
+
+	// Band of coefficient k: bit length of k (octaves of the spectrum)
+	static int band(size_t k) {
+		int b = 0;
+		while(k && b < BANDS - 1) {
+			b++;
+			k >>= 1;
+		}
+		return b;
+	}
+
+	// Bit length of v, up to "max" - 1
+	static int level(unsigned long v, int max) {
+		int l = 0;
+		while(v && l < max - 1) {
+			l++;
+			v >>= 1;
+		}
+		return l;
+	}
+
+	// Codes (Coder::bit returns the bit it was given) or decodes (it returns the
+	// bit it read) the number of bit planes of a block
+	template<typename Coder>
+	int plane_count(Coder& coder, const unsigned long* mag, size_t coeffs) {
+		unsigned long peak = 0;
+		for(size_t k = 0 ; k < coeffs ; k++)
+			peak |= mag[k];
+		int planes = 0;
+		while(peak >> planes)
+			planes++;
+
+		size_t node = 1;
+		for(int i = PLANE_BITS - 1 ; i >= 0 ; i--)
+			node = 2 * node + coder.bit(m_planes[node], (planes >> i) & 1);
+		return static_cast<int>(node - (size_t { 1 } << PLANE_BITS));
+	}
+
+	// Codes or decodes plane p of a block. The magnitudes must hold the bits
+	// already known (all of them when encoding, those above p when decoding);
+	// "prev" is the previous block of the same channel, if any, of which only
+	// the bits in "known" are used.
+	template<typename Coder>
+	void plane(Coder& coder, unsigned long* mag, uint8_t* negative, const unsigned long* prev, size_t coeffs, int p,
+	  unsigned long known) {
+		for(size_t k = 0 ; k < coeffs ; k++) {
+			const int b = band(k);
+			unsigned long high = mag[k] >> (p + 1);
+			int bit;
+			if(high) {
+				int r = level(high >> 1, REFINEMENTS + 1);
+				if(r < REFINEMENTS)
+					bit = coder.bit(m_refinement[b][r], (mag[k] >> p) & 1);
+				else
+					bit = coder.bypass((mag[k] >> p) & 1);
+			} else {
+				// Known magnitudes around the coefficient, in units of 2^p
+				unsigned long here = (k > 0 ? mag[k - 1] >> p : 0) + (k + 1 < coeffs ? (mag[k + 1] >> (p + 1)) << 1 : 0);
+				// Bit length of the local mean of the previous block, relative to p
+				int above = 0;
+				if(prev) {
+					unsigned long mean = (2 * (prev[k] & known) + (k > 0 ? prev[k - 1] & known : 0) +
+					  (k + 1 < coeffs ? prev[k + 1] & known : 0)) >> 2;
+					above = std::clamp(level(mean, 64) - p, -DISTANCE, DISTANCE);
+				}
+				bit = coder.bit(m_significance[b][level(here, LEVELS)][above + DISTANCE], (mag[k] >> p) & 1);
+				if(bit)
+					negative[k] = static_cast<uint8_t>(coder.bypass(negative[k]));
+			}
+			mag[k] |= static_cast<unsigned long>(bit) << p;
+		}
+	}
+
+	struct Writer {
+		BinaryEncoder& encoder;
+		int bit(BitModel& model, int b) {
+			encoder.encode(model, b);
+			return b;
+		}
+		int bypass(int b) {
+			encoder.encode_bypass(b);
+			return b;
+		}
+	};
+
+	struct Reader {
+		BinaryDecoder& decoder;
+		int bit(BitModel& model, int) {
+			return decoder.decode(model);
+		}
+		int bypass(int) {
+			return decoder.decode_bypass();
+		}
+	};
+
+	static void split(const std::vector<long>& coefs, std::vector<unsigned long>& mag, std::vector<uint8_t>& negative) {
+		mag.resize(coefs.size());
+		negative.resize(coefs.size());
+		for(size_t i = 0 ; i < coefs.size() ; i++) {
+			mag[i] = coefs[i] < 0 ? -static_cast<unsigned long>(coefs[i]) : coefs[i];
+			negative[i] = coefs[i] < 0;
+		}
+	}
+
+	static void join(const std::vector<unsigned long>& mag, const std::vector<uint8_t>& negative, std::vector<long>& coefs) {
+		coefs.resize(mag.size());
+		for(size_t i = 0 ; i < mag.size() ; i++)
+			coefs[i] = negative[i] ? -static_cast<long>(mag[i]) : static_cast<long>(mag[i]);
+	}
+
+  public:
+	static void write(BitPacker& packer, const std::vector<long>& coefs, size_t coeffs, size_t channels) {
+		std::vector<unsigned long> mag;
+		std::vector<uint8_t> negative;
+		split(coefs, mag, negative);
+
+		DCTPlanes model;
+		BinaryEncoder encoder;
+		Writer writer { encoder };
+		const size_t stride = coeffs * channels;
+		for(size_t first = 0 ; coeffs && first + coeffs <= coefs.size() ; first += coeffs) {
+			const unsigned long* prev = first >= stride ? mag.data() + first - stride : nullptr;
+			for(int p = model.plane_count(writer, mag.data() + first, coeffs) - 1 ; p >= 0 ; p--)
+				model.plane(writer, mag.data() + first, negative.data() + first, prev, coeffs, p, ~0ul);
+		}
+		encoder.finish();
+		packer.append(encoder.data().data(), encoder.data().size());
+	}
+
+	// Returns the number of coefficients read (less than "n" if the payload ends)
+	static size_t read(const std::vector<uint8_t>& payload, size_t n, size_t coeffs, size_t channels, std::vector<long>& coefs) {
+		std::vector<unsigned long> mag(n, 0);
+		std::vector<uint8_t> negative(n, 0);
+
+		DCTPlanes model;
+		BinaryDecoder decoder(payload.data(), payload.size());
+		Reader reader { decoder };
+		const size_t stride = coeffs * channels;
+		size_t first = 0;
+		for( ; coeffs && first + coeffs <= n ; first += coeffs) {
+			const unsigned long* prev = first >= stride ? mag.data() + first - stride : nullptr;
+			for(int p = model.plane_count(reader, mag.data() + first, coeffs) - 1 ; p >= 0 ; p--)
+				model.plane(reader, mag.data() + first, negative.data() + first, prev, coeffs, p, ~0ul);
+			if(decoder.overrun())
+				break;
+		}
+
+		join(mag, negative, coefs);
+		return first;
+	}
+
+	// Embedded payload: the plane counts of all the blocks, then plane by plane
+	// from the most significant one, that plane of every block that has it. The
+	// contexts use only bits already sent, so any prefix of the payload decodes
+	// to the coefficients with their low planes missing.
+	static void write_embedded(BitPacker& packer, const std::vector<long>& coefs, size_t coeffs, size_t channels) {
+		std::vector<unsigned long> mag;
+		std::vector<uint8_t> negative;
+		split(coefs, mag, negative);
+
+		DCTPlanes model;
+		BinaryEncoder encoder;
+		Writer writer { encoder };
+		const size_t blocks = coeffs ? coefs.size() / coeffs : 0;
+		std::vector<int> planes(blocks);
+		int top = 0;
+		for(size_t b = 0 ; b < blocks ; b++)
+			top = std::max(top, planes[b] = model.plane_count(writer, mag.data() + b * coeffs, coeffs));
+		for(int p = top - 1 ; p >= 0 ; p--)
+			for(size_t b = 0 ; b < blocks ; b++)
+				if(p < planes[b])
+					model.plane(writer, mag.data() + b * coeffs, negative.data() + b * coeffs,
+					  b >= channels ? mag.data() + (b - channels) * coeffs : nullptr, coeffs, p, ~0ul << p);
+		encoder.finish();
+		packer.append(encoder.data().data(), encoder.data().size());
+	}
+
+	// Decodes an embedded payload, possibly truncated. Each block gets the planes
+	// decoded before the data ran out, and its significant coefficients are set
+	// to the middle of the interval left by the missing planes. Returns the
+	// lowest plane decoded in every block (0 for a complete payload).
+	static int read_embedded(const std::vector<uint8_t>& payload, size_t n, size_t coeffs, size_t channels, std::vector<long>& coefs) {
+		std::vector<unsigned long> mag(n, 0), saved(coeffs);
+		std::vector<uint8_t> negative(n, 0), saved_negative(coeffs);
+
+		DCTPlanes model;
+		BinaryDecoder decoder(payload.data(), payload.size());
+		Reader reader { decoder };
+		const size_t blocks = coeffs ? n / coeffs : 0;
+		std::vector<int> planes(blocks), known(blocks);
+		int top = 0;
+		for(size_t b = 0 ; b < blocks ; b++)
+			top = std::max(top, planes[b] = known[b] = model.plane_count(reader, mag.data() + b * coeffs, coeffs));
+		if(decoder.overrun()) {
+			join(std::vector<unsigned long>(n, 0), negative, coefs);
+			return top;
+		}
+
+		// A plane whose decoding ran past the data is dropped, since its last
+		// decisions may depend on the missing bytes
+		int lowest = 0;
+		for(int p = top - 1 ; p >= 0 && not decoder.overrun() ; p--)
+			for(size_t b = 0 ; b < blocks ; b++) {
+				if(p >= planes[b])
+					continue;
+				unsigned long* m = mag.data() + b * coeffs;
+				uint8_t* neg = negative.data() + b * coeffs;
+				std::copy(m, m + coeffs, saved.begin());
+				std::copy(neg, neg + coeffs, saved_negative.begin());
+				model.plane(reader, m, neg, b >= channels ? mag.data() + (b - channels) * coeffs : nullptr, coeffs, p, ~0ul << p);
+				if(decoder.overrun()) {
+					std::copy(saved.begin(), saved.end(), m);
+					std::copy(saved_negative.begin(), saved_negative.end(), neg);
+					lowest = p + 1;
+					break;
+				}
+				known[b] = p;
+			}
+
+		for(size_t b = 0 ; b < blocks ; b++)
+			if(known[b] > 0)
+				for(size_t k = b * coeffs ; k < (b + 1) * coeffs ; k++)
+					if(mag[k])
+						mag[k] |= 1ul << (known[b] - 1);
+		join(mag, negative, coefs);
+		return lowest;
+	}
+};
+
+// Value that wav_dct_dec reads back from a RAW coefficient of "qbits" bits
+// (the low bits of the coefficient, as a signed 32-bit value)
+inline long raw_coefficient(long q, int qbits) {
+	uint64_t bits = static_cast<uint64_t>(q);
+	if(qbits < 32)
+		bits &= (uint64_t { 1 } << qbits) - 1;
+	return static_cast<int32_t>(bits);
+}
+
+// Distortion estimate of the encoder, from the coefficients (Parseval). FFTW's
+// transforms are not normalised: an error e on coefficient k of an N-point
+// DCT-II is an error of energy e^2 / 4N in the samples for k = 0 and
+// e^2 / 2N otherwise. The MDCT (a DCT-IV with TDAC windows) weighs every
+// coefficient by 1 / 2N, which holds for the sum over the overlapping frames.
+// The rounding and clipping of the decoded samples to 16 bits are left out.
+struct DCTDistortion {
+	double	signal { };
+	double	noise { };
+
+	static double weight(size_t k, size_t n, bool mdct) {
+		return (k == 0 && not mdct ? 0.25 : 0.5) / n;
+	}
+
+	void add(double coef, double decoded, double weight) {
+		signal += weight * coef * coef;
+		noise += weight * (coef - decoded) * (coef - decoded);
+	}
+
+	void add(const DCTDistortion& d) {
+		signal += d.signal;
+		noise += d.noise;
+	}
+
+	double snr() const {
+		return noise == 0 ? INFINITY : 10 * log10(signal / noise);
+	}
+
+	double mse(size_t samples) const {
+		return samples ? noise / samples : 0;
+	}
+};
+
+// Quality-targeted coding (-target-snr): each block has its own quantization
+// step, 2^(step / 4), and keeps its first "count" coefficients (interleaved
+// order for short blocks). The encoder picks, for every block, the step and
+// count of lowest estimated rate whose distortion (DCTDistortion) is within
+// the block's share of the target, its own energy / 10^(snr / 10); meeting
+// the target in every block meets it for the whole file. RAW streams store
+// the coefficients of a block in "bits" bits, two's complement; HUFFMAN and
+// RANS code the kept coefficients only, CABAC and EMBEDDED code blocks of the
+// largest count, padded with zeros. The parameters follow the header: count
+// (16), step (8) and, for RAW, bits (6).
+struct DCTBlockParams {
+	size_t	count { };
+	int		step { };
+	int		bits { };
+
+	double scale() const {
+		return exp2(step / 4.0);
+	}
+};
+
+struct DCTTarget {
+	static constexpr int STEPS = 256;
+	static constexpr int MAX_BITS = 32;		// Widest RAW field that BitStream::write_n_bits handles
+
+	// "x" holds the coefficients of the block and "weight" their DCTDistortion
+	// weights; "budget" is the distortion allowed. If no step meets it, the
+	// block is coded with step 0 and every coefficient.
+	static DCTBlockParams choose(const std::vector<double>& x, const std::vector<double>& weight, double budget,
+	  bool raw) {
+		const size_t n = x.size();
+		double peak = 0;
+		for(size_t i = 0 ; i < n ; i++)
+			peak = std::max(peak, std::fabs(x[i]));
+
+		// Energy of the coefficients from each index on (summed from the end, so
+		// that a small tail is not lost next to a large first coefficient)
+		std::vector<double> tail(n + 1, 0.0);
+		for(size_t i = n ; i-- > 0 ; )
+			tail[i] = tail[i + 1] + weight[i] * x[i] * x[i];
+		budget *= 1 + 1e-9;
+
+		DCTBlockParams best { n, 0, 0 };
+		double bestRate = INFINITY;
+		// From the coarsest step that keeps a coefficient (the ones above
+		// quantize everything to zero) down to finer steps, until their rate is
+		// twice the best one: beyond that the rate only grows with the precision
+		int top = static_cast<int>(std::ceil(4 * std::log2(2 * peak + 1)));
+		for(int step = std::min(top, STEPS - 1) ; step >= 0 ; step--) {
+			const double d = exp2(step / 4.0);
+
+			// Smallest count within the budget: the error of the first "count"
+			// coefficients plus the energy of the rest
+			double head = 0;
+			size_t count = n + 1;
+			for(size_t c = 0 ; c <= n ; c++) {
+				if(head + tail[c] <= budget) {
+					count = c;
+					break;
+				}
+				if(c == n)
+					break;
+				double e = x[c] - lround(x[c] / d) * d;
+				head += weight[c] * e * e;
+			}
+
+			if(count <= n) {
+				// Rate estimate: the category and extra bits of the entropy
+				// coders, or the field width times the count for RAW
+				int bits = 0;
+				double rate = 0;
+				for(size_t i = 0 ; i < count ; i++) {
+					long v = lround(x[i] / d);
+					int c = DCTCoef::category(v);
+					bits = std::max(bits, c + 1);
+					rate += c + 1;
+				}
+				if(raw)
+					rate = static_cast<double>(count) * bits;
+				if(raw && bits > MAX_BITS)
+					continue;
+				if(rate < bestRate) {
+					bestRate = rate;
+					best = { count, step, count ? bits : 0 };
+				} else if(rate > 2 * bestRate)
+					break;
+			}
+		}
+
+		// Every coefficient, with the finest step whose RAW field fits MAX_BITS
+		for( ; bestRate == INFINITY ; best.step++) {
+			int bits = 0;
+			for(size_t i = 0 ; i < n ; i++)
+				bits = std::max(bits, DCTCoef::category(lround(x[i] / best.scale())) + 1);
+			if(not raw || bits <= MAX_BITS) {
+				best.bits = bits;
+				break;
+			}
+		}
+		return best;
+	}
+
+	static void write(BitStream& bs, const std::vector<DCTBlockParams>& params, bool raw) {
+		for(const DCTBlockParams& p : params) {
+			bs.write_n_bits(p.count, 16);
+			bs.write_n_bits(p.step, 8);
+			if(raw)
+				bs.write_n_bits(p.bits, 6);
+		}
+	}
+
+	// Returns false, with a message in "error", if a block keeps more than
+	// "coeffs" coefficients
+	static bool read(BitStream& bs, size_t blocks, bool raw, size_t coeffs, std::vector<DCTBlockParams>& params,
+	  std::string& error) {
+		params.resize(blocks);
+		for(DCTBlockParams& p : params) {
+			p.count = bs.read_n_bits(16);
+			p.step = static_cast<int>(bs.read_n_bits(8));
+			p.bits = raw ? static_cast<int>(bs.read_n_bits(6)) : 0;
+			if(p.count > coeffs || p.bits > MAX_BITS) {
+				error = "invalid block parameters";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Offset of the coefficients of each block in the list of the entropy
+	// coders, with blocks of "stride" coefficients (0 for the kept ones only)
+	static std::vector<size_t> offsets(const std::vector<DCTBlockParams>& params, size_t stride) {
+		std::vector<size_t> offset(params.size() + 1, 0);
+		for(size_t n = 0 ; n < params.size() ; n++)
+			offset[n + 1] = offset[n] + (stride ? stride : params[n].count);
+		return offset;
+	}
+
+	// The largest count, the block size of CABAC and EMBEDDED
+	static size_t stride(const std::vector<DCTBlockParams>& params) {
+		size_t stride = 0;
+		for(const DCTBlockParams& p : params)
+			stride = std::max(stride, p.count);
+		return stride;
+	}
+};
+
+// Payload bytes of the non-RAW coders go through the BitStream after their count
+inline void write_payload(BitStream& bs, const BitPacker& packer) {
+	bs.write_n_bits(packer.size(), 32);
+	for(size_t i = 0 ; i < packer.size() ; i++)
+		bs.write_n_bits(packer.data()[i], 8);
+}
+
+inline std::vector<uint8_t> read_payload(BitStream& bs) {
+	std::vector<uint8_t> payload(bs.read_n_bits(32));
+	for(uint8_t& b : payload)
+		b = static_cast<uint8_t>(bs.read_n_bits(8));
+	return payload;
+}
+
+// The EMBEDDED payload has no count and ends with the file
+inline void write_embedded_payload(BitStream& bs, const BitPacker& packer) {
+	for(size_t i = 0 ; i < packer.size() ; i++)
+		bs.write_n_bits(packer.data()[i], 8);
+}
+
+inline std::vector<uint8_t> read_embedded_payload(BitStream& bs) {
+	std::vector<uint8_t> payload;
+	for(;;) {
+		uint64_t b = bs.read_n_bits(8);	// All ones past the end of the file
+		if(b > 0xFF)
+			break;
+		payload.push_back(static_cast<uint8_t>(b));
+	}
+	return payload;
+}
+
+#endif
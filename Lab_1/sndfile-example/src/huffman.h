@@ -0,0 +1,241 @@
+#ifndef HUFFMAN_H
+#define HUFFMAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include "bit_pack.h"
+
+// Canonical Huffman code over the alphabet [0, symbols()). The code lengths are
+// built from a histogram and limited to a maximum length; the codes follow from
+// the lengths alone (shorter codes first, ties by symbol), so only the lengths
+// are stored. Encoding is a table lookup. Decoding peeks MAX_LENGTH bits and
+// resolves the symbol with one ROOT_BITS lookup, plus a second one in a
+// subtable for the few codes longer than ROOT_BITS.
+class Huffman {
+  public:
+	static constexpr int MAX_LENGTH = 24;
+	static constexpr int ROOT_BITS = 11;
+	static constexpr uint32_t INVALID = 0xFFFFFFFF;	// decode() of a bit pattern that is no code
+
+  private:
+	// Either a symbol and the length of its code, or (sub_bits > 0) the offset
+	// of a subtable indexed by the next sub_bits bits
+	struct Entry {
+		uint32_t	value { };
+		uint8_t		length { };		// 0 for bit patterns of no code (incomplete codes)
+		uint8_t		sub_bits { };
+	};
+
+	std::vector<uint8_t>	m_lengths;
+	std::vector<uint32_t>	m_codes;
+	std::vector<Entry>		m_table;
+
+	// Plain Huffman code lengths (0 for symbols that do not occur)
+	static std::vector<uint8_t> huffman_lengths(const std::vector<size_t>& counts) {
+		struct Node { size_t count; int left, right; };
+		std::vector<Node> nodes;
+		using Item = std::pair<size_t, int>;
+		std::priority_queue<Item, std::vector<Item>, std::greater<Item>> heap;
+		for(size_t s = 0 ; s < counts.size() ; s++)
+			if(counts[s] > 0) {
+				nodes.push_back({ counts[s], -1, static_cast<int>(s) });
+				heap.push({ counts[s], static_cast<int>(nodes.size()) - 1 });
+			}
+
+		std::vector<uint8_t> lengths(counts.size(), 0);
+		if(nodes.size() == 1)
+			lengths[nodes[0].right] = 1;
+		if(nodes.size() < 2)
+			return lengths;
+
+		while(heap.size() > 1) {
+			auto [c1, a] = heap.top();
+			heap.pop();
+			auto [c2, b] = heap.top();
+			heap.pop();
+			nodes.push_back({ c1 + c2, a, b });
+			heap.push({ c1 + c2, static_cast<int>(nodes.size()) - 1 });
+		}
+
+		// Depth of every leaf (children always precede their parent)
+		std::vector<int> depth(nodes.size(), 0);
+		for(int i = static_cast<int>(nodes.size()) - 1 ; i >= 0 ; i--) {
+			if(nodes[i].left < 0)
+				lengths[nodes[i].right] = static_cast<uint8_t>(std::min(depth[i], 255));
+			else
+				depth[nodes[i].left] = depth[nodes[i].right] = depth[i] + 1;
+		}
+		return lengths;
+	}
+
+	void assign_codes() {
+		int max_length = 0;
+		for(uint8_t l : m_lengths)
+			max_length = std::max<int>(max_length, l);
+
+		std::vector<uint32_t> count(max_length + 2, 0), next(max_length + 2, 0);
+		for(uint8_t l : m_lengths)
+			count[l]++;
+		count[0] = 0;
+		uint32_t code = 0;
+		for(int l = 1 ; l <= max_length ; l++) {
+			code = (code + count[l - 1]) << 1;
+			next[l] = code;
+		}
+
+		m_codes.assign(m_lengths.size(), 0);
+		for(size_t s = 0 ; s < m_lengths.size() ; s++)
+			if(m_lengths[s])
+				m_codes[s] = next[m_lengths[s]]++;
+	}
+
+	void build_table() {
+		m_table.assign(size_t { 1 } << ROOT_BITS, Entry { });
+
+		// Longest code behind each root prefix, to size the subtables
+		std::vector<int> sub_bits(size_t { 1 } << ROOT_BITS, 0);
+		for(size_t s = 0 ; s < m_lengths.size() ; s++) {
+			int l = m_lengths[s];
+			if(l > ROOT_BITS) {
+				uint32_t prefix = m_codes[s] >> (l - ROOT_BITS);
+				sub_bits[prefix] = std::max(sub_bits[prefix], l - ROOT_BITS);
+			}
+		}
+		for(size_t p = 0 ; p < sub_bits.size() ; p++)
+			if(sub_bits[p]) {
+				m_table[p].value = static_cast<uint32_t>(m_table.size());
+				m_table[p].sub_bits = static_cast<uint8_t>(sub_bits[p]);
+				m_table.resize(m_table.size() + (size_t { 1 } << sub_bits[p]));
+			}
+
+		for(size_t s = 0 ; s < m_lengths.size() ; s++) {
+			int l = m_lengths[s];
+			if(l == 0)
+				continue;
+			Entry e { static_cast<uint32_t>(s), static_cast<uint8_t>(l), 0 };
+			if(l <= ROOT_BITS) {
+				size_t first = size_t { m_codes[s] } << (ROOT_BITS - l);
+				std::fill_n(m_table.begin() + first, size_t { 1 } << (ROOT_BITS - l), e);
+			} else {
+				const Entry& root = m_table[m_codes[s] >> (l - ROOT_BITS)];
+				int extra = l - ROOT_BITS;
+				uint32_t low = m_codes[s] & ((1u << extra) - 1);
+				size_t first = root.value + (size_t { low } << (root.sub_bits - extra));
+				std::fill_n(m_table.begin() + first, size_t { 1 } << (root.sub_bits - extra), e);
+			}
+		}
+	}
+
+  public:
+	Huffman() = default;
+
+	// Code with the given lengths, which must satisfy the Kraft inequality
+	explicit Huffman(std::vector<uint8_t> lengths) : m_lengths { std::move(lengths) } {
+		assign_codes();
+		build_table();
+	}
+
+	// Optimal code for "counts" among those with no code longer than "max_length"
+	// (approximately: the counts are flattened until the plain Huffman code fits)
+	static Huffman from_histogram(const std::vector<size_t>& counts, int max_length = MAX_LENGTH) {
+		std::vector<size_t> c = counts;
+		for(;;) {
+			std::vector<uint8_t> lengths = huffman_lengths(c);
+			if(lengths.empty() || *std::max_element(lengths.begin(), lengths.end()) <= max_length)
+				return Huffman { std::move(lengths) };
+			for(size_t& v : c)
+				if(v > 0)
+					v = (v + 1) / 2;
+		}
+	}
+
+	size_t symbols() const { return m_lengths.size(); }
+	int length(uint32_t symbol) const { return m_lengths[symbol]; }
+
+	// Total length, in bits, of the symbols counted in "counts"
+	uint64_t cost(const std::vector<size_t>& counts) const {
+		uint64_t bits = 0;
+		for(size_t s = 0 ; s < counts.size() && s < m_lengths.size() ; s++)
+			bits += uint64_t { counts[s] } * m_lengths[s];
+		return bits;
+	}
+
+	void encode(BitPacker& packer, uint32_t symbol) const {
+		packer.put(m_codes[symbol], m_lengths[symbol]);
+	}
+
+	// Returns INVALID, consuming nothing, if the next bits are not a code
+	uint32_t decode(BitUnpacker& unpacker) const {
+		uint32_t bits = unpacker.peek(MAX_LENGTH);
+		const Entry* e = &m_table[bits >> (MAX_LENGTH - ROOT_BITS)];
+		if(e->sub_bits) {
+			uint32_t index = (bits >> (MAX_LENGTH - ROOT_BITS - e->sub_bits)) & ((1u << e->sub_bits) - 1);
+			e = &m_table[e->value + index];
+		}
+		if(e->length == 0)
+			return INVALID;
+		unpacker.skip(e->length);
+		return e->value;
+	}
+
+	// Code table: alphabet size (24 bits), then the length of each symbol in
+	// 5 bits; a zero length is followed by the number (8 bits) of further
+	// symbols that also have zero length
+	void write(BitPacker& packer) const {
+		packer.put(static_cast<uint32_t>(m_lengths.size()), 24);
+		for(size_t s = 0 ; s < m_lengths.size() ; ) {
+			packer.put(m_lengths[s], 5);
+			if(m_lengths[s]) {
+				s++;
+				continue;
+			}
+			size_t run = 1;
+			while(run < 256 && s + run < m_lengths.size() && m_lengths[s + run] == 0)
+				run++;
+			packer.put(static_cast<uint32_t>(run - 1), 8);
+			s += run;
+		}
+	}
+
+	// Returns false, with a message in "error", if the table is not valid
+	static bool read(BitUnpacker& unpacker, Huffman& code, std::string& error) {
+		size_t n = unpacker.get(24);
+		std::vector<uint8_t> lengths;
+		lengths.reserve(n);
+		while(lengths.size() < n && not unpacker.overrun()) {
+			uint8_t l = static_cast<uint8_t>(unpacker.get(5));
+			if(l == 0)
+				lengths.insert(lengths.end(), unpacker.get(8) + 1, 0);
+			else
+				lengths.push_back(l);
+		}
+		if(unpacker.overrun() || lengths.size() != n) {
+			error = "truncated or invalid Huffman table";
+			return false;
+		}
+
+		// Kraft inequality, in units of 2^-MAX_LENGTH
+		uint64_t kraft = 0;
+		for(uint8_t l : lengths) {
+			if(l > MAX_LENGTH) {
+				error = "Huffman code longer than " + std::to_string(MAX_LENGTH) + " bits";
+				return false;
+			}
+			if(l)
+				kraft += uint64_t { 1 } << (MAX_LENGTH - l);
+		}
+		if(kraft > (uint64_t { 1 } << MAX_LENGTH)) {
+			error = "invalid Huffman code lengths";
+			return false;
+		}
+
+		code = Huffman { std::move(lengths) };
+		return true;
+	}
+};
+
+#endif
@@ -2,7 +2,7 @@ import matplotlib.pyplot as plt
 import numpy as np
 import sys
 
-def plot_histogram(filename, title):
+def plot_histogram(filename, title, bin_width=None):
     # Read the data from the file
     data = np.loadtxt(filename)
     
@@ -12,14 +12,11 @@ def plot_histogram(filename, title):
     
     # Create the plot
     plt.figure(figsize=(12, 6))
-    # Calculate appropriate bar width
-    if len(x) > 1:
-        min_gap = np.min(np.diff(np.sort(x)))
-        bar_width = min_gap * 0.8
+    # wav_hist -bins outputs the lower edge of fixed-width bins
+    if bin_width is not None:
+        plt.bar(x, y, width=bin_width, align='edge')
     else:
-        bar_width = 1000
-
-    plt.bar(x, y, width=bar_width)
+        plot_bars(x, y)
 
     if len(x) > 0:
         x_min, x_max = x.min(), x.max()
@@ -38,9 +35,19 @@ def plot_histogram(filename, title):
     plt.close()
     print(f"Plot saved as {output_file}")
 
+def plot_bars(x, y):
+    # Calculate appropriate bar width
+    if len(x) > 1:
+        min_gap = np.min(np.diff(np.sort(x)))
+        bar_width = min_gap * 0.8
+    else:
+        bar_width = 1000
+
+    plt.bar(x, y, width=bar_width)
+
 if __name__ == "__main__":
-    if len(sys.argv) != 3:
-        print("Usage: python plot_histogram.py <histogram_file.txt> <title>")
+    if len(sys.argv) not in (3, 4):
+        print("Usage: python plot_histogram.py <histogram_file.txt> <title> [bin_width]")
         sys.exit(1)
     
-    plot_histogram(sys.argv[1], sys.argv[2])
\ No newline at end of file
+    plot_histogram(sys.argv[1], sys.argv[2], float(sys.argv[3]) if len(sys.argv) == 4 else None)
\ No newline at end of file
@@ -0,0 +1,345 @@
+#ifndef QUANTIZER_H
+#define QUANTIZER_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define QUANTIZER_X86
+#endif
+
+// Uniform scalar quantizers for 16-bit samples, shared by wav_quant and by
+// wav_quant_enc/wav_quant_dec. With "bits" index bits the step is 2^(16-bits)
+// and indices lie in [0, 2^bits):
+//   MID_RISE   floor thresholds, reconstruction at the middle of the step
+//   MID_TREAD  rounding thresholds, reconstruction on multiples of the step
+//   TRUNCATE   floor thresholds, reconstruction at the lower edge (low bits cleared)
+// LLOYD_MAX selects the non-uniform LloydMaxQuantizer below instead.
+// The values match the 2-bit mode field of the WQ01 header (0 = legacy mid-rise).
+enum class QuantMode : uint8_t { MID_RISE = 0, MID_TREAD = 1, TRUNCATE = 2, LLOYD_MAX = 3 };
+
+inline bool parse_quant_mode(const std::string& name, QuantMode& mode) {
+	if(name == "midrise")
+		mode = QuantMode::MID_RISE;
+	else if(name == "midtread")
+		mode = QuantMode::MID_TREAD;
+	else if(name == "trunc")
+		mode = QuantMode::TRUNCATE;
+	else if(name == "lloyd")
+		mode = QuantMode::LLOYD_MAX;
+	else
+		return false;
+
+	return true;
+}
+
+inline const char* quant_mode_name(QuantMode mode) {
+	switch(mode) {
+		case QuantMode::MID_RISE: return "midrise";
+		case QuantMode::MID_TREAD: return "midtread";
+		case QuantMode::LLOYD_MAX: return "lloyd";
+		default: return "trunc";
+	}
+}
+
+// All three quantizers reduce to integer operations on the sample s:
+//   index(s)          = min((s + 32768 + pre) >> shift, levels - 1)
+//   reconstruct(q)    = (q << shift) - 32768 + post
+//   reconstruct(index(s)) = (sat16(s + pre) & mask) + post
+// Optionally, a 65536-entry table maps every sample to its index directly.
+// Without the table, encode() computes the index on 16-bit lanes as
+// sat_u16((s ^ 0x8000) + pre) >> shift, where the unsigned saturation performs
+// the clamp to levels - 1; the widest SIMD kernel of the CPU is used.
+class UniformQuantizer {
+  private:
+	using IndexKernel = void (*)(const int16_t*, size_t, uint16_t*, uint16_t, int);
+
+	QuantMode				m_mode;
+	int						m_bits;
+	int						m_shift;
+	int16_t					m_pre;
+	int16_t					m_post;
+	std::vector<uint16_t>	m_lut;		// Sample (as uint16_t) -> index
+	std::vector<int16_t>	m_recon;	// Index -> reconstructed sample
+	IndexKernel				m_kernel;
+
+	static void index_scalar(const int16_t* samples, size_t n, uint16_t* indices, uint16_t pre, int shift) {
+		for(size_t i = 0 ; i < n ; i++) {
+			uint32_t u = (static_cast<uint16_t>(samples[i]) ^ 0x8000u) + pre;
+			indices[i] = static_cast<uint16_t>(std::min<uint32_t>(u, 65535) >> shift);
+		}
+	}
+
+#ifdef QUANTIZER_X86
+	__attribute__((target("sse2")))
+	static void index_sse2(const int16_t* samples, size_t n, uint16_t* indices, uint16_t pre, int shift) {
+		const __m128i flip = _mm_set1_epi16(static_cast<int16_t>(0x8000));
+		const __m128i a = _mm_set1_epi16(static_cast<int16_t>(pre));
+		const __m128i sh = _mm_cvtsi32_si128(shift);
+		size_t i = 0;
+		for( ; i + 8 <= n ; i += 8) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i));
+			v = _mm_srl_epi16(_mm_adds_epu16(_mm_xor_si128(v, flip), a), sh);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(indices + i), v);
+		}
+		index_scalar(samples + i, n - i, indices + i, pre, shift);
+	}
+
+	__attribute__((target("avx2")))
+	static void index_avx2(const int16_t* samples, size_t n, uint16_t* indices, uint16_t pre, int shift) {
+		const __m256i flip = _mm256_set1_epi16(static_cast<int16_t>(0x8000));
+		const __m256i a = _mm256_set1_epi16(static_cast<int16_t>(pre));
+		const __m128i sh = _mm_cvtsi32_si128(shift);
+		size_t i = 0;
+		for( ; i + 16 <= n ; i += 16) {
+			__m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i));
+			v = _mm256_srl_epi16(_mm256_adds_epu16(_mm256_xor_si256(v, flip), a), sh);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(indices + i), v);
+		}
+		index_scalar(samples + i, n - i, indices + i, pre, shift);
+	}
+#endif
+
+  public:
+	// "bits" must be in [1, 16]
+	UniformQuantizer(QuantMode mode, int bits, bool use_lut = false) : m_mode { mode },
+	  m_bits { bits }, m_shift { 16 - bits }, m_kernel { index_scalar } {
+		m_pre = pre_offset(mode, bits);
+		m_post = post_offset(mode, bits);
+
+		m_recon.resize(levels());
+		for(int q = 0 ; q < levels() ; q++)
+			m_recon[q] = static_cast<int16_t>((q << m_shift) - 32768 + m_post);
+
+		if(use_lut) {
+			m_lut.resize(65536);
+			for(int s = -32768 ; s < 32768 ; s++)
+				m_lut[static_cast<uint16_t>(s)] = compute_index(static_cast<int16_t>(s));
+		}
+
+#ifdef QUANTIZER_X86
+		__builtin_cpu_init();
+		if(__builtin_cpu_supports("avx2"))
+			m_kernel = index_avx2;
+		else if(__builtin_cpu_supports("sse2"))
+			m_kernel = index_sse2;
+#endif
+	}
+
+	QuantMode mode() const { return m_mode; }
+	int bits() const { return m_bits; }
+	int levels() const { return 1 << m_bits; }
+
+	// Parameters of the in-place form, for vectorized kernels
+	int16_t pre_offset() const { return m_pre; }
+	int16_t post_offset() const { return m_post; }
+	int16_t mask() const { return mask(m_bits); }
+
+	// The same, without building a quantizer (and its tables)
+	static int16_t pre_offset(QuantMode mode, int bits) {
+		return mode == QuantMode::MID_TREAD ? static_cast<int16_t>((1 << (16 - bits)) >> 1) : 0;
+	}
+	static int16_t post_offset(QuantMode mode, int bits) {
+		return mode == QuantMode::MID_RISE ? static_cast<int16_t>((1 << (16 - bits)) >> 1) : 0;
+	}
+	static int16_t mask(int bits) {
+		return static_cast<int16_t>(~((1 << (16 - bits)) - 1));
+	}
+
+	uint16_t compute_index(int16_t s) const {
+		uint32_t u = static_cast<uint32_t>(s + 32768 + m_pre) >> m_shift;
+		return static_cast<uint16_t>(std::min<uint32_t>(u, levels() - 1));
+	}
+
+	uint16_t index(int16_t s) const {
+		return m_lut.empty() ? compute_index(s) : m_lut[static_cast<uint16_t>(s)];
+	}
+
+	int16_t reconstruct(uint16_t q) const {
+		return m_recon[q];
+	}
+
+	void encode(const int16_t* samples, size_t n, uint16_t* indices) const {
+		if(not m_lut.empty()) {
+			for(size_t i = 0 ; i < n ; i++)
+				indices[i] = m_lut[static_cast<uint16_t>(samples[i])];
+		} else {
+			m_kernel(samples, n, indices, static_cast<uint16_t>(m_pre), m_shift);
+		}
+	}
+
+	// Indices must be smaller than levels()
+	void decode(const uint16_t* indices, size_t n, int16_t* samples) const {
+		for(size_t i = 0 ; i < n ; i++)
+			samples[i] = m_recon[indices[i]];
+	}
+
+	// Replaces each sample by its reconstruction
+	void quant(int16_t* samples, size_t n) const {
+		if(not m_lut.empty()) {
+			for(size_t i = 0 ; i < n ; i++)
+				samples[i] = m_recon[m_lut[static_cast<uint16_t>(samples[i])]];
+		} else {
+			const int32_t msk = mask();
+			for(size_t i = 0 ; i < n ; i++) {
+				int32_t v = std::min<int32_t>(samples[i] + m_pre, 32767);
+				samples[i] = static_cast<int16_t>((v & msk) + m_post);
+			}
+		}
+	}
+};
+
+// Non-uniform scalar quantizer with a codebook of 2^bits reconstruction levels,
+// trained with the Lloyd-Max algorithm on a histogram of the 65536 sample
+// values (indexed like WAVHist: value + 32768). Encoding goes through a direct
+// 65536-entry index table, decoding through the codebook itself.
+class LloydMaxQuantizer {
+  private:
+	std::vector<int16_t>	m_codebook;	// Sorted reconstruction levels
+	std::vector<uint16_t>	m_lut;		// Sample (as uint16_t) -> index
+
+	void build_lut() {
+		m_lut.resize(65536);
+		size_t q = 0;
+		for(int s = -32768 ; s < 32768 ; s++) {
+			// Move to the next level once s is past the midpoint (ties go down)
+			while(q + 1 < m_codebook.size() && 2 * s > m_codebook[q] + m_codebook[q + 1])
+				q++;
+			m_lut[static_cast<uint16_t>(s)] = static_cast<uint16_t>(q);
+		}
+	}
+
+  public:
+	// Codebook as stored in a WQ01 header; it must have a power of two size
+	LloydMaxQuantizer(std::vector<int16_t> codebook) : m_codebook { std::move(codebook) } {
+		std::sort(m_codebook.begin(), m_codebook.end());
+		build_lut();
+	}
+
+	// Trains a 2^bits level codebook on "hist" (65536 counters). Lloyd-Max
+	// alternates nearest-neighbour thresholds and cell centroids, using prefix
+	// sums so that each iteration costs O(levels). Since it only finds a local
+	// optimum, it is run from two starting points (uniform levels over the range
+	// of the data, and the quantiles of the histogram) and the best is kept.
+	static LloydMaxQuantizer train(const std::vector<size_t>& hist, int bits, int max_iter = 200) {
+		const size_t n_levels = size_t { 1 } << bits;
+		std::vector<double> mass(65537), moment(65537);
+		for(size_t v = 0 ; v < 65536 ; v++) {
+			mass[v + 1] = mass[v] + hist[v];
+			moment[v + 1] = moment[v] + hist[v] * (static_cast<double>(v) - 32768);
+		}
+		const double total = mass[65536];
+
+		size_t lo = 0, hi = 65535;
+		while(lo < hi && hist[lo] == 0)
+			lo++;
+		while(hi > lo && hist[hi] == 0)
+			hi--;
+
+		std::vector<double> uniform(n_levels), quantile(n_levels);
+		const double step = (hi - lo + 1.0) / n_levels;
+		size_t v = 0;
+		for(size_t j = 0 ; j < n_levels ; j++) {
+			uniform[j] = lo - 32768.0 + (j + 0.5) * step;
+			while(v < 65535 && mass[v + 1] < total * (j + 0.5) / n_levels)
+				v++;
+			quantile[j] = static_cast<double>(v) - 32768;
+		}
+
+		LloydMaxQuantizer best { lloyd(mass, moment, uniform, max_iter) };
+		LloydMaxQuantizer other { lloyd(mass, moment, quantile, max_iter) };
+		return other.mse(hist) < best.mse(hist) ? other : best;
+	}
+
+  private:
+	static std::vector<int16_t> lloyd(const std::vector<double>& mass, const std::vector<double>& moment,
+	  std::vector<double> y, int max_iter) {
+		const size_t n_levels = y.size();
+
+		// Keep levels distinct and inside the 16-bit range
+		for(size_t j = 1 ; j < n_levels ; j++)
+			y[j] = std::max(y[j], y[j - 1] + 1);
+		y[n_levels - 1] = std::min(y[n_levels - 1], 32767.0);
+		for(size_t j = n_levels - 1 ; j > 0 ; j--)
+			y[j - 1] = std::min(y[j - 1], y[j] - 1);
+
+		std::vector<size_t> start(n_levels + 1);
+		for(int it = 0 ; it < max_iter ; it++) {
+			// Cell j holds the offset values in [start[j], start[j + 1])
+			start[0] = 0;
+			start[n_levels] = 65536;
+			for(size_t j = 1 ; j < n_levels ; j++) {
+				double t = std::floor((y[j - 1] + y[j]) / 2) + 32768 + 1;
+				start[j] = static_cast<size_t>(std::clamp(t, 0.0, 65536.0));
+			}
+
+			double change = 0;
+			for(size_t j = 0 ; j < n_levels ; j++) {
+				double m = mass[start[j + 1]] - mass[start[j]];
+				if(m > 0) {
+					double c = (moment[start[j + 1]] - moment[start[j]]) / m;
+					change = std::max(change, std::abs(c - y[j]));
+					y[j] = c;
+				}
+			}
+
+			if(change < 1e-3)
+				break;
+		}
+
+		std::vector<int16_t> codebook(n_levels);
+		for(size_t j = 0 ; j < n_levels ; j++)
+			codebook[j] = static_cast<int16_t>(std::clamp(std::lround(y[j]), -32768L, 32767L));
+
+		return codebook;
+	}
+
+  public:
+	int levels() const { return static_cast<int>(m_codebook.size()); }
+	const std::vector<int16_t>& codebook() const { return m_codebook; }
+
+	uint16_t index(int16_t s) const {
+		return m_lut[static_cast<uint16_t>(s)];
+	}
+
+	int16_t reconstruct(uint16_t q) const {
+		return m_codebook[q];
+	}
+
+	void encode(const int16_t* samples, size_t n, uint16_t* indices) const {
+		for(size_t i = 0 ; i < n ; i++)
+			indices[i] = m_lut[static_cast<uint16_t>(samples[i])];
+	}
+
+	// Indices must be smaller than levels()
+	void decode(const uint16_t* indices, size_t n, int16_t* samples) const {
+		for(size_t i = 0 ; i < n ; i++)
+			samples[i] = m_codebook[indices[i]];
+	}
+
+	void quant(int16_t* samples, size_t n) const {
+		for(size_t i = 0 ; i < n ; i++)
+			samples[i] = m_codebook[m_lut[static_cast<uint16_t>(samples[i])]];
+	}
+
+	// Mean squared error of the quantizer over the samples counted in "hist"
+	double mse(const std::vector<size_t>& hist) const {
+		double err = 0, total = 0;
+		for(int s = -32768 ; s < 32768 ; s++) {
+			size_t c = hist[s + 32768];
+			if(c) {
+				double d = s - reconstruct(index(static_cast<int16_t>(s)));
+				err += c * d * d;
+				total += c;
+			}
+		}
+		return total > 0 ? err / total : 0.0;
+	}
+};
+
+#endif
@@ -0,0 +1,275 @@
+#ifndef RANS_H
+#define RANS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "bit_pack.h"
+
+// Static-model rANS coder with N interleaved states (byte-wise renormalization,
+// 32-bit states in [2^23, 2^31)). Symbol i is coded by state i % N, so the N
+// decode chains are independent and the decode loop has N-way instruction
+// level parallelism. The symbol frequencies are normalized to a total of
+// 2^prob_bits, with prob_bits in [12, 16] chosen from the number of symbols used.
+class RANSCode {
+  public:
+	static constexpr uint32_t LOWER = 1u << 23;
+	static constexpr int STATES = 4;	// Interleaved states of the stored streams
+
+  private:
+	// Decode table entry for every slot in [0, 2^prob_bits)
+	struct Slot {
+		uint16_t	symbol;
+		uint16_t	freq_m1;	// Frequency - 1
+		uint16_t	bias;		// Slot - cumulative frequency of the symbol
+	};
+
+	int						m_prob_bits { 12 };
+	std::vector<uint32_t>	m_freq;
+	std::vector<uint32_t>	m_start;
+	std::vector<Slot>		m_slots;
+
+	// Elias gamma code of v >= 1: the bit length of v less one in zeros, then v
+	static void put_gamma(BitPacker& packer, uint32_t v) {
+		int n = 0;
+		while(v >> n)
+			n++;
+		packer.put(0, n - 1);
+		packer.put(v, n);
+	}
+
+	// Returns 0 if the code is longer than that of any value of "max_bits" bits
+	static uint32_t get_gamma(BitUnpacker& unpacker, int max_bits) {
+		int n = 1;
+		while(unpacker.get(1) == 0)
+			if(++n > max_bits || unpacker.overrun())
+				return 0;
+		return (1u << (n - 1)) | (n > 1 ? unpacker.get(n - 1) : 0);
+	}
+
+	void build() {
+		m_start.assign(m_freq.size(), 0);
+		m_slots.assign(size_t { 1 } << m_prob_bits, Slot { });
+		uint32_t start = 0;
+		for(size_t s = 0 ; s < m_freq.size() ; s++) {
+			m_start[s] = start;
+			for(uint32_t j = 0 ; j < m_freq[s] ; j++)
+				m_slots[start + j] = { static_cast<uint16_t>(s), static_cast<uint16_t>(m_freq[s] - 1),
+				  static_cast<uint16_t>(j) };
+			start += m_freq[s];
+		}
+	}
+
+  public:
+	RANSCode() = default;
+
+	// Frequencies must be zero or positive and add up to 2^prob_bits
+	RANSCode(std::vector<uint32_t> freq, int prob_bits) : m_prob_bits { prob_bits }, m_freq { std::move(freq) } {
+		build();
+	}
+
+	static RANSCode from_histogram(const std::vector<size_t>& counts) {
+		size_t used = 0, total = 0;
+		for(size_t c : counts) {
+			used += c > 0;
+			total += c;
+		}
+		int prob_bits = 12;
+		while(prob_bits < 16 && (size_t { 1 } << prob_bits) < 8 * used)
+			prob_bits++;
+		const uint32_t target = 1u << prob_bits;
+
+		std::vector<uint32_t> freq(counts.size(), 0);
+		if(total == 0) {
+			if(not freq.empty())
+				freq[0] = target;
+			return RANSCode { std::move(freq), prob_bits };
+		}
+
+		// Proportional frequencies, at least 1 for every symbol that occurs
+		int64_t sum = 0;
+		for(size_t s = 0 ; s < counts.size() ; s++)
+			if(counts[s] > 0) {
+				freq[s] = std::max<uint32_t>(1, static_cast<uint32_t>(static_cast<double>(counts[s]) * target / total));
+				sum += freq[s];
+			}
+
+		// Correct the total on the most frequent symbols first
+		std::vector<uint32_t> order;
+		for(size_t s = 0 ; s < counts.size() ; s++)
+			if(counts[s] > 0)
+				order.push_back(static_cast<uint32_t>(s));
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return counts[a] > counts[b]; });
+		while(sum != target)
+			for(uint32_t s : order) {
+				if(sum < target) {
+					freq[s]++;
+					sum++;
+				} else if(sum > target && freq[s] > 1) {
+					freq[s]--;
+					sum--;
+				}
+				if(sum == target)
+					break;
+			}
+
+		return RANSCode { std::move(freq), prob_bits };
+	}
+
+	size_t symbols() const { return m_freq.size(); }
+	int prob_bits() const { return m_prob_bits; }
+
+	// Codes "n" symbols; returns the byte stream
+	template<int N = 4, typename Symbol>
+	std::vector<uint8_t> encode(const Symbol* symbols, size_t n) const {
+		std::vector<uint8_t> buf(2 * n + 4 * N + 16);
+		uint8_t* ptr = buf.data() + buf.size();
+		uint32_t x[N];
+		std::fill(x, x + N, LOWER);
+
+		// Backwards, so that the decoder reads forwards
+		for(size_t i = n ; i-- > 0 ; ) {
+			uint32_t& xs = x[i % N];
+			const uint32_t s = symbols[i], freq = m_freq[s];
+			const uint32_t x_max = ((LOWER >> m_prob_bits) << 8) * freq;
+			while(xs >= x_max) {
+				*--ptr = static_cast<uint8_t>(xs);
+				xs >>= 8;
+			}
+			xs = ((xs / freq) << m_prob_bits) + (xs % freq) + m_start[s];
+		}
+		for(int j = N - 1 ; j >= 0 ; j--) {
+			ptr -= 4;
+			for(int b = 0 ; b < 4 ; b++)
+				ptr[b] = static_cast<uint8_t>(x[j] >> (24 - 8 * b));
+		}
+
+		return std::vector<uint8_t>(ptr, buf.data() + buf.size());
+	}
+
+	// Decodes up to "n" symbols; returns how many were decoded, which is less
+	// than "n" only if the data runs out
+	template<int N = 4, typename Symbol>
+	size_t decode(const uint8_t* data, size_t size, Symbol* symbols, size_t n) const {
+		if(size < 4 * N)
+			return 0;
+		const uint8_t* ptr = data;
+		const uint8_t* end = data + size;
+		uint32_t x[N];
+		for(int j = 0 ; j < N ; j++, ptr += 4)
+			x[j] = (uint32_t { ptr[0] } << 24) | (uint32_t { ptr[1] } << 16) | (uint32_t { ptr[2] } << 8) | ptr[3];
+
+		const uint32_t mask = (1u << m_prob_bits) - 1;
+		size_t i = 0;
+		// Main loop: N symbols per iteration, renormalizing with bounds checks
+		// only when fewer than 2 * N bytes remain
+		for( ; i + N <= n ; i += N) {
+			for(int j = 0 ; j < N ; j++) {
+				const Slot& slot = m_slots[x[j] & mask];
+				symbols[i + j] = static_cast<Symbol>(slot.symbol);
+				x[j] = (uint32_t { slot.freq_m1 } + 1) * (x[j] >> m_prob_bits) + slot.bias;
+			}
+			if(end - ptr >= 2 * N) {
+				for(int j = 0 ; j < N ; j++)
+					while(x[j] < LOWER)
+						x[j] = (x[j] << 8) | *ptr++;
+			} else {
+				for(int j = 0 ; j < N ; j++)
+					while(x[j] < LOWER) {
+						if(ptr == end)
+							return i + N;
+						x[j] = (x[j] << 8) | *ptr++;
+					}
+			}
+		}
+		for(int j = 0 ; i < n ; i++, j++) {
+			const Slot& slot = m_slots[x[j] & mask];
+			symbols[i] = static_cast<Symbol>(slot.symbol);
+		}
+		return n;
+	}
+
+	// Table: alphabet size (24 bits), prob_bits (5 bits), then each frequency f
+	// as the Elias gamma code of f + 1; a zero frequency is followed by the
+	// number (8 bits) of further symbols that also have zero frequency
+	void write(BitPacker& packer) const {
+		packer.put(static_cast<uint32_t>(m_freq.size()), 24);
+		packer.put(m_prob_bits, 5);
+		for(size_t s = 0 ; s < m_freq.size() ; ) {
+			put_gamma(packer, m_freq[s] + 1);
+			if(m_freq[s]) {
+				s++;
+				continue;
+			}
+			size_t run = 1;
+			while(run < 256 && s + run < m_freq.size() && m_freq[s + run] == 0)
+				run++;
+			packer.put(static_cast<uint32_t>(run - 1), 8);
+			s += run;
+		}
+	}
+
+	// Returns false, with a message in "error", if the table is not valid
+	static bool read(BitUnpacker& unpacker, RANSCode& code, std::string& error) {
+		size_t n = unpacker.get(24);
+		int prob_bits = static_cast<int>(unpacker.get(5));
+		if(prob_bits < 12 || prob_bits > 16) {
+			error = "invalid rANS probability precision";
+			return false;
+		}
+		std::vector<uint32_t> freq;
+		freq.reserve(n);
+		uint64_t sum = 0;
+		while(freq.size() < n && not unpacker.overrun()) {
+			uint32_t f = get_gamma(unpacker, prob_bits + 1) - 1;
+			if(f == 0)
+				freq.insert(freq.end(), unpacker.get(8) + 1, 0);
+			else
+				freq.push_back(f);
+			sum += f;
+		}
+		if(unpacker.overrun() || freq.size() != n || sum != (uint64_t { 1 } << prob_bits)) {
+			error = "truncated or invalid rANS table";
+			return false;
+		}
+		code = RANSCode { std::move(freq), prob_bits };
+		return true;
+	}
+
+	// Coded stream: the table, the byte count (32 bits) of the rANS bytes and,
+	// from the next byte boundary, the rANS bytes of the STATES-way interleaved coder
+	template<typename Symbol>
+	void write_stream(BitPacker& packer, const Symbol* symbols, size_t n) const {
+		std::vector<uint8_t> bytes = encode<STATES>(symbols, n);
+		write(packer);
+		packer.put(static_cast<uint32_t>(bytes.size()), 32);
+		packer.finish();
+		packer.append(bytes.data(), bytes.size());
+	}
+
+	// Decodes up to "n" symbols of a stream written by write_stream at "data",
+	// whose table must cover "alphabet" symbols. Returns how many were decoded,
+	// with a message in "error" if the table is not valid, and sets "end" to the
+	// offset of the byte after the stream.
+	template<typename Symbol>
+	static size_t read_stream(const uint8_t* data, size_t size, size_t alphabet, Symbol* symbols, size_t n,
+	  size_t& end, std::string& error) {
+		BitUnpacker unpacker(data, size);
+		RANSCode code;
+		if(not read(unpacker, code, error))
+			return 0;
+		if(code.symbols() != alphabet) {
+			error = "rANS table does not match the alphabet";
+			return 0;
+		}
+		size_t count = unpacker.get(32);
+		size_t offset = unpacker.align();
+		count = std::min(count, size - offset);
+		end = offset + count;
+		return code.decode<STATES>(data + offset, count, symbols, n);
+	}
+};
+
+#endif
@@ -17,8 +17,8 @@
 #include <iostream>
 #include <vector>
 #include <cmath>
-#include <fftw3.h>
 #include <sndfile.hh>
+#include "wav_dct.h"
 
 using namespace std;
 
@@ -100,17 +100,16 @@ int main(int argc, char *argv[]) {
 	// Vector for holding all DCT coefficients, channel by channel
 	vector<vector<double>> x_dct(nChannels, vector<double>(nBlocks * bs));
 
-	// Vector for holding DCT computations
-	vector<double> x(bs);
+	// Block DCT buffer and plans
+	WAVDct dct { bs };
+	vector<double>& x { dct.data() };
 
 	// Direct DCT
-	fftw_plan plan_d = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT10, FFTW_ESTIMATE);
 	for(size_t n = 0 ; n < nBlocks ; n++)
 		for(size_t c = 0 ; c < nChannels ; c++) {
-			for(size_t k = 0 ; k < bs ; k++)
-				x[k] = samples[(n * bs + k) * nChannels + c];
+			dct.load(samples, n, nChannels, c);
 
-			fftw_execute(plan_d);
+			dct.forward();
 			// Keep only "dctFrac" of the "low frequency" coefficients
 			for(size_t k = 0 ; k < bs * dctFrac ; k++)
 				x_dct[c][n * bs + k] = x[k] / (bs << 1);
@@ -118,13 +117,12 @@ int main(int argc, char *argv[]) {
 		}
 
 	// Inverse DCT
-	fftw_plan plan_i = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
 	for(size_t n = 0 ; n < nBlocks ; n++)
 		for(size_t c = 0 ; c < nChannels ; c++) {
 			for(size_t k = 0 ; k < bs ; k++)
 				x[k] = x_dct[c][n * bs + k];
 
-			fftw_execute(plan_i);
+			dct.inverse();
 			for(size_t k = 0 ; k < bs ; k++)
 				samples[(n * bs + k) * nChannels + c] = static_cast<short>(round(x[k]));
 
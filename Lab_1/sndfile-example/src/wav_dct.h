@@ -0,0 +1,54 @@
+#ifndef WAVDCT_H
+#define WAVDCT_H
+
+#include <vector>
+#include <fftw3.h>
+
+// Block DCT set up as in wav_dct: one buffer of "bs" doubles with an in-place
+// DCT-II (forward) and DCT-III (inverse) plan. FFTW's transforms are not
+// normalised, so inverse(forward(x)) yields 2 * bs * x.
+class WAVDct {
+  private:
+    size_t bs;
+    std::vector<double> x;
+    fftw_plan plan_d;
+    fftw_plan plan_i;
+
+  public:
+    WAVDct(size_t bs) : bs { bs }, x(bs) {
+        plan_d = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT10, FFTW_ESTIMATE);
+        plan_i = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
+    }
+
+    ~WAVDct() {
+        fftw_destroy_plan(plan_d);
+        fftw_destroy_plan(plan_i);
+    }
+
+    WAVDct(const WAVDct&) = delete;
+    WAVDct& operator=(const WAVDct&) = delete;
+
+    size_t size() const {
+        return bs;
+    }
+
+    std::vector<double>& data() {
+        return x;
+    }
+
+    // Copies channel "c" of block "n" from interleaved samples into the buffer
+    void load(const std::vector<short>& samples, size_t n, size_t nChannels, size_t c) {
+        for(size_t k = 0 ; k < bs ; k++)
+            x[k] = samples[(n * bs + k) * nChannels + c];
+    }
+
+    void forward() {
+        fftw_execute(plan_d);
+    }
+
+    void inverse() {
+        fftw_execute(plan_i);
+    }
+};
+
+#endif
@@ -6,9 +6,13 @@
 #include <fstream>
 #include <string>
 #include <cstdint>
+#include <memory>
+#include <algorithm>
 
 #include "bit_stream.h"
 #include "byte_stream.h"
+#include "dct_codec.h"
+#include "wav_mdct.h"
 
 using namespace std;
 
@@ -16,9 +20,11 @@ int main(int argc, char *argv[]) {
 
     // Default values (will be overwritten by metadata)
 	bool verbose { false };
+	int preview { 0 };
 
 	if (argc < 3) {
         cerr << "Usage: wav_dct_dec [ -v (verbose) ]\n"; 
+        cerr << "                   [ -preview k (output at 1/2^k of the sample rate, def 0) ]\n";
         cerr << "                   encFileIn wavFileOut\n";
         return 1;
     }
@@ -29,6 +35,12 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
+    for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-preview") {
+			preview = atoi(argv[n+1]);
+			break;
+		}
+
     // --- Input BitStream setup ---
     fstream fsIn { argv[argc-2], ios::in | ios::binary };
     if(!fsIn.is_open()) {
@@ -38,15 +50,17 @@ int main(int argc, char *argv[]) {
     BitStream bsIn { fsIn, STREAM_READ };
 
     // --- 1. Read Metadata from BitStream ---
-    int sampleRate = static_cast<int>(bsIn.read_n_bits(32));
-    // Read block size (16 bits)
-    size_t bs = static_cast<size_t>(bsIn.read_n_bits(16));
-    // Read number of *kept* coefficients (16 bits)
-    size_t nDctCoeffsPerBlock = static_cast<size_t>(bsIn.read_n_bits(16));
-    // Read number of bits used for quantization (8 bits)
-    int N_BITS_QUANT = static_cast<int>(bsIn.read_n_bits(8));
-    // Read total number of frames (32 bits)
-    sf_count_t nFrames = static_cast<sf_count_t>(bsIn.read_n_bits(32));
+    DCTHeader header;
+    string error;
+    if(!header.read(bsIn, error)) {
+        cerr << "Error: " << error << endl;
+        return 1;
+    }
+    int sampleRate = static_cast<int>(header.sample_rate);
+    size_t bs = header.block_size;
+    size_t nDctCoeffsPerBlock = header.coeffs;
+    int N_BITS_QUANT = header.qbits;
+    sf_count_t nFrames = static_cast<sf_count_t>(header.frames);
 
     const size_t nChannels = 1;
 
@@ -65,32 +79,147 @@ int main(int argc, char *argv[]) {
         return 1;
     }
     
+    // Preview: a (bs / 2^k)-point IDCT of the lowest coefficients of each block
+    // gives the block at 1/2^k of the sample rate (each output sample is the
+    // signal at the centre of 2^k input samples, band-limited to the new rate)
+    if (preview < 0 || preview > 16 || (bs >> preview) == 0 || (bs >> preview << preview) != bs) {
+        cerr << "Error: -preview " << preview << " does not divide the block size " << bs << endl;
+        return 1;
+    }
+    const size_t outBs = bs >> preview;
+    if (header.mdct() && outBs % 2) {
+        cerr << "Error: -preview " << preview << " leaves an odd MDCT size\n";
+        return 1;
+    }
+    const size_t shortBs = bs / DCTSwitch::SHORT_BLOCKS;
+    const size_t outShortBs = shortBs >> preview;
+    if (header.switching && (outShortBs == 0 || (outShortBs << preview) != shortBs)) {
+        cerr << "Error: -preview " << preview << " does not divide the short block size " << shortBs << endl;
+        return 1;
+    }
+    if (preview > 0) {
+        sampleRate >>= preview;
+        if (verbose) cerr << "Preview: " << outBs << "-point IDCT, " << sampleRate << " Hz\n";
+    }
+
     // --- 4. IDCT Setup and Processing ---
 
-    size_t nBlocks = static_cast<size_t>(ceil(static_cast<double>(nFrames) / bs));
+    size_t nBlocks = header.blocks();
 
     // Vector for holding IDCT computations for the current block (same size as block size)
     vector<double> x(bs);
 
     // Inverse DCT plan (FFTW_REDFT01 is IDCT-II, the inverse of DCT-II)
-    fftw_plan plan_id = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
+    fftw_plan plan_id = fftw_plan_r2r_1d(outBs, x.data(), x.data(), FFTW_REDFT01, FFTW_ESTIMATE);
+
+    // Block switching: one flag per block, then the inverse of the short DCTs
+    // of the flagged blocks
+    vector<bool> shortBlocks(nBlocks, false);
+    if (header.switching) {
+        shortBlocks = DCTSwitch::read(bsIn, nBlocks);
+        if (verbose) cerr << "Short blocks: " << count(shortBlocks.begin(), shortBlocks.end(), true) << " of " << nBlocks << endl;
+    }
+    const size_t shortCoeffs = nDctCoeffsPerBlock / DCTSwitch::SHORT_BLOCKS;
+
+    // -target-snr streams: the step and number of coefficients of every block
+    vector<DCTBlockParams> params;
+    if (header.adaptive) {
+        if (!DCTTarget::read(bsIn, nBlocks * nChannels, header.coder == DCTCoder::RAW, nDctCoeffsPerBlock, params, error)) {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+        if (verbose) cerr << "Adaptive quantization: " << DCTTarget::offsets(params, 0).back() << " coefficients kept\n";
+    }
+    vector<double> xs(max<size_t>(outShortBs, 1));
+    fftw_plan plan_is = fftw_plan_r2r_1d(xs.size(), xs.data(), xs.data(), FFTW_REDFT01, FFTW_ESTIMATE);
 
     // Vector to store the reconstructed audio samples
-    vector<short> samples(nBlocks * bs * nChannels);
+    vector<short> samples(nBlocks * outBs * nChannels);
+
+    // MDCT: the inverse of frame n is overlap-added over blocks n - 1 and n of
+    // the signal (the first block of "overlap" is the encoder's zero padding)
+    unique_ptr<WAVMdct> mdct;
+    vector<double> overlap;
+    if (header.mdct()) {
+        mdct = make_unique<WAVMdct>(outBs, header.transform == DCTTransform::MDCT_KBD ? MDCTWindow::KBD : MDCTWindow::SINE);
+        overlap.assign((nBlocks + 1) * outBs, 0.0);
+        if (verbose) cerr << "Transform: MDCT (" << (header.transform == DCTTransform::MDCT_KBD ? "KBD" : "sine") << " window)\n";
+    }
 
     if(verbose) cerr << "Decoding " << nBlocks << " blocks...\n";
 
+    // Entropy coded streams: decode every coefficient up front. With -target-snr,
+    // HUFFMAN and RANS hold the kept coefficients only and CABAC and EMBEDDED
+    // blocks of the largest count.
+    vector<long> coefs;
+    size_t codedCoeffs = nDctCoeffsPerBlock;
+    vector<size_t> offset;
+    if(header.adaptive) {
+        bool planes = header.coder == DCTCoder::CABAC || header.coder == DCTCoder::EMBEDDED;
+        codedCoeffs = planes ? DCTTarget::stride(params) : 0;
+        offset = DCTTarget::offsets(params, codedCoeffs);
+    }
+    const size_t total = header.adaptive ? offset.back() : nBlocks * nChannels * nDctCoeffsPerBlock;
+    if(header.coder == DCTCoder::EMBEDDED) {
+        vector<uint8_t> payload = read_embedded_payload(bsIn);
+        int plane = DCTPlanes::read_embedded(payload, total, codedCoeffs, nChannels, coefs);
+        if(plane > 0)
+            cerr << "Warning: truncated embedded stream, decoded down to bit plane " << plane << "\n";
+    } else if(header.coder != DCTCoder::RAW) {
+        vector<uint8_t> payload = read_payload(bsIn);
+        BitUnpacker unpacker(payload.data(), payload.size());
+        size_t n = 0;
+        if(header.coder == DCTCoder::HUFFMAN)
+            n = DCTCoef::read_huffman(unpacker, total, coefs, error);
+        else if(header.coder == DCTCoder::RANS)
+            n = DCTCoef::read_rans(payload, total, coefs, error);
+        else
+            n = DCTPlanes::read(payload, total, codedCoeffs, nChannels, coefs);
+        if(!error.empty()) {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+        if(n < coefs.size())
+            cerr << "Warning: stream ends after " << n << " of " << coefs.size() << " coefficients\n";
+        coefs.resize(total, 0);
+    }
+    size_t nextCoef = 0;
+
     for(size_t n = 0 ; n < nBlocks ; n++) {
         for(size_t c = 0 ; c < nChannels ; c++) { // nChannels is 1 (mono)
 
             // --- De-quantization and IDCT Input Setup ---
 
             // 1. Clear the DCT vector. Only the first nDctCoeffsPerBlock will be populated.
-            for (size_t k = 0; k < bs; k++)
+            for (size_t k = 0; k < outBs; k++)
                 x[k] = 0.0;
 
             // 2. Read quantized coefficients and place them in the vector 'x'
-            for(size_t k = 0 ; k < nDctCoeffsPerBlock ; k++) {
+            //    (in preview mode, the IDCT only uses the first outBs of them)
+            // (-target-snr: the first "count" coefficients, scaled by the block's step)
+            if(header.adaptive) {
+                const DCTBlockParams& p = params[n * nChannels + c];
+                for(size_t k = 0 ; k < nDctCoeffsPerBlock ; k++) {
+                    long q_val = 0;
+                    if(k < p.count && header.coder != DCTCoder::RAW)
+                        q_val = coefs[offset[n * nChannels + c] + k];
+                    else if(k < p.count) {
+                        // Two's complement in p.bits bits
+                        uint64_t raw_val = bsIn.read_n_bits(p.bits);
+                        q_val = static_cast<long>(raw_val);
+                        if(p.bits > 0 && (raw_val >> (p.bits - 1)) & 1)
+                            q_val -= static_cast<long>(uint64_t { 1 } << p.bits);
+                    }
+                    x[k] = static_cast<double>(q_val) * p.scale();
+                }
+            }
+
+            for(size_t k = 0 ; k < nDctCoeffsPerBlock && !header.adaptive ; k++) {
+                if(header.coder != DCTCoder::RAW) {
+                    x[k] = static_cast<double>(coefs[nextCoef++]);
+                    continue;
+                }
+
                 // Read the N_BITS_QUANT value
                 uint64_t raw_val = bsIn.read_n_bits(N_BITS_QUANT);
 
@@ -103,15 +232,39 @@ int main(int argc, char *argv[]) {
                 x[k] = static_cast<double>(q_val);
             }
 
+            if(mdct) {
+                // 3-4. Inverse MDCT, scaled once the overlap-add is complete
+                copy(x.begin(), x.begin() + outBs, mdct->data().begin());
+                mdct->inverse_add(overlap.data() + n * outBs);
+                continue;
+            }
+
+            if(shortBlocks[n]) {
+                // 3-4. Inverse of each short DCT, scaled by 2*shortBs
+                for(size_t s = 0 ; s < DCTSwitch::SHORT_BLOCKS ; s++) {
+                    for(size_t k = 0 ; k < outShortBs ; k++)
+                        xs[k] = k < shortCoeffs ? x[k * DCTSwitch::SHORT_BLOCKS + s] : 0.0;
+                    fftw_execute(plan_is);
+                    for(size_t k = 0 ; k < outShortBs ; k++) {
+                        long scaled_sample = lround(xs[k] / (2.0 * shortBs));
+                        if (scaled_sample > 32767) scaled_sample = 32767;
+                        if (scaled_sample < -32768) scaled_sample = -32768;
+                        samples[(n * outBs + s * outShortBs + k) * nChannels + c] = static_cast<short>(scaled_sample);
+                    }
+                }
+                continue;
+            }
+
             // 3. Execute IDCT
             fftw_execute(plan_id);
 
             // 4. Scaling and storing the reconstructed time-domain samples
             // The unnormalized DCT-II/IDCT-II pair in FFTW results in a factor of 2*bs.
-            // We must divide by this factor to restore the original magnitude.
+            // We must divide by this factor to restore the original magnitude
+            // (2*bs also in preview mode, since the coefficients are those of bs samples).
             double scale = 2.0 * bs;
 
-            for(size_t k = 0 ; k < bs ; k++) {
+            for(size_t k = 0 ; k < outBs ; k++) {
                 // Scale the IDCT output and cast to short for WAV format
                 long scaled_sample = lround(x[k] / scale);
 
@@ -119,16 +272,26 @@ int main(int argc, char *argv[]) {
                 if (scaled_sample > 32767) scaled_sample = 32767;
                 if (scaled_sample < -32768) scaled_sample = -32768;
 
-                samples[(n * bs + k) * nChannels + c] = static_cast<short>(scaled_sample);
+                samples[(n * outBs + k) * nChannels + c] = static_cast<short>(scaled_sample);
             }
         }
     }
 
+    if(mdct) {
+        // The same 2*bs factor as the DCT, after the time-domain aliasing cancellation
+        for(size_t j = 0 ; j < samples.size() ; j++) {
+            long scaled_sample = lround(overlap[outBs + j] / (2.0 * bs));
+            if (scaled_sample > 32767) scaled_sample = 32767;
+            if (scaled_sample < -32768) scaled_sample = -32768;
+            samples[j] = static_cast<short>(scaled_sample);
+        }
+    }
+
 
     // --- 5. Output WAV File Setup and Writing ---
 
     // Determine the number of frames to write (original nFrames, ignoring zero-padding)
-    sf_count_t nFramesToWrite = nFrames;
+    sf_count_t nFramesToWrite = (nFrames + (sf_count_t { 1 } << preview) - 1) >> preview;
     
     int sf_format = SF_FORMAT_WAV | SF_FORMAT_PCM_16; // 16-bit PCM WAV
 
@@ -154,6 +317,7 @@ int main(int argc, char *argv[]) {
 
     // --- 6. Cleanup ---
     fftw_destroy_plan(plan_id);
+    fftw_destroy_plan(plan_is);
     fsIn.close();
 
     if(verbose) cerr << "Decoding complete.\n";
@@ -5,9 +5,14 @@
 #include <sndfile.hh>
 #include <fstream>
 #include <string>
+#include <memory>
+#include <algorithm>
+#include <iomanip>
 
 #include "bit_stream.h"
 #include "byte_stream.h"
+#include "dct_codec.h"
+#include "wav_mdct.h"
 
 using namespace std;
 
@@ -19,12 +24,28 @@ int main(int argc, char *argv[]) {
 	size_t bs { 1024 };
 	double dctFrac { 0.2 };
     int N_BITS_QUANT { 32 };
+    DCTCoder coder { DCTCoder::RAW };
+    DCTTransform transform { DCTTransform::DCT };
+    bool switching { false };
+    bool estimate { false };
+    bool estimateBlocks { false };
+    bool adaptive { false };
+    double targetSnr { 0 };
 
 	if(argc < 3) {
 		cerr << "Usage: wav_dct_enc [ -v (verbose) ]\n";
 		cerr << "                   [ -bs blockSize (def 1024) ]\n";
 		cerr << "                   [ -frac dctFraction (def 0.2) ]\n";
         cerr << "                   [ -qbits quantizationBits (def 32) ]\n";
+		cerr << "                   [ -huffman (entropy code the coefficients) ]\n";
+		cerr << "                   [ -rans (rANS code the coefficients) ]\n";
+		cerr << "                   [ -cabac (bit-plane arithmetic coding, highest ratio) ]\n";
+		cerr << "                   [ -embedded (bit-plane stream that can be cut at any byte) ]\n";
+		cerr << "                   [ -mdct sine|kbd (overlapped MDCT instead of block DCT) ]\n";
+		cerr << "                   [ -switch (short blocks on transients, block DCT only) ]\n";
+		cerr << "                   [ -snr (print the estimated SNR/MSE, without decoding) ]\n";
+		cerr << "                   [ -snr-blocks (the same, also per block) ]\n";
+		cerr << "                   [ -target-snr dB (per block step and coefficients, instead of -frac/-qbits) ]\n";
 		cerr << "                   wavFileIn encFileOut\n";
 		return 1;
 	}
@@ -56,6 +77,85 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
+	// One entropy coder at most: -huffman, -rans, -cabac or -embedded
+	for(int n = 1 ; n < argc ; n++) {
+		DCTCoder c;
+		string arg { argv[n] };
+		if(arg == "-huffman")
+			c = DCTCoder::HUFFMAN;
+		else if(arg == "-rans")
+			c = DCTCoder::RANS;
+		else if(arg == "-cabac")
+			c = DCTCoder::CABAC;
+		else if(arg == "-embedded")
+			c = DCTCoder::EMBEDDED;
+		else
+			continue;
+		if(coder != DCTCoder::RAW && coder != c) {
+			cerr << "Error: -huffman, -rans, -cabac and -embedded cannot be combined\n";
+			return 1;
+		}
+		coder = c;
+	}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-mdct") {
+			string window = argv[n+1];
+			if(window == "sine")
+				transform = DCTTransform::MDCT_SINE;
+			else if(window == "kbd")
+				transform = DCTTransform::MDCT_KBD;
+			else {
+				cerr << "Error: unknown MDCT window " << window << " (sine or kbd)\n";
+				return 1;
+			}
+			if(bs % 2) {
+				cerr << "Error: the MDCT needs an even block size\n";
+				return 1;
+			}
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-switch") {
+			switching = true;
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-snr" || string(argv[n]) == "-snr-blocks") {
+			estimate = true;
+			estimateBlocks = string(argv[n]) == "-snr-blocks";
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-target-snr") {
+			adaptive = true;
+			size_t end { 0 };
+			try {
+				if(n + 1 < argc)
+					targetSnr = stod(argv[n+1], &end);
+			} catch(const exception&) {
+				end = 0;
+			}
+			if(n + 1 >= argc || end == 0 || argv[n+1][end] != '\0' || !isfinite(targetSnr) || targetSnr <= 0) {
+				cerr << "Error: -target-snr needs a positive SNR in dB\n";
+				return 1;
+			}
+			break;
+		}
+
+	if(switching && transform != DCTTransform::DCT) {
+		cerr << "Error: -switch needs the block DCT (no -mdct)\n";
+		return 1;
+	}
+
+	if(switching && (bs % DCTSwitch::SHORT_BLOCKS)) {
+		cerr << "Error: -switch needs a block size multiple of " << DCTSwitch::SHORT_BLOCKS << "\n";
+		return 1;
+	}
+
 	SndfileHandle sfhIn { argv[argc-2] };
     
 	if(sfhIn.error()) {
@@ -97,16 +197,23 @@ int main(int argc, char *argv[]) {
     // Create BitStream in write mode (STREAM_WRITE is defined in byte_stream.h)
     BitStream bsOut { fsOut, STREAM_WRITE };
 
-    size_t nDctCoeffsPerBlock = static_cast<size_t>(bs * dctFrac);
+    // With -target-snr, each block may keep up to all of its coefficients
+    size_t nDctCoeffsPerBlock = adaptive ? bs : static_cast<size_t>(bs * dctFrac);
 
     // --- 4. Write Encoder Header (Parameters needed for Decoder) ---
     if(verbose) cerr << "Writing header info to encoded file...\n";
 
-    bsOut.write_n_bits(static_cast<uint64_t>(sampleRate), 32);
-    bsOut.write_n_bits(static_cast<uint64_t>(bs), 16);
-    bsOut.write_n_bits(static_cast<uint64_t>(nDctCoeffsPerBlock), 16);
-    bsOut.write_n_bits(static_cast<uint64_t>(N_BITS_QUANT), 8);
-    bsOut.write_n_bits(static_cast<uint64_t>(nFrames), 32);
+    DCTHeader header;
+    header.sample_rate = sampleRate;
+    header.block_size = bs;
+    header.coeffs = nDctCoeffsPerBlock;
+    header.qbits = N_BITS_QUANT;
+    header.frames = nFrames;
+    header.coder = coder;
+    header.transform = transform;
+    header.switching = switching;
+    header.adaptive = adaptive;
+    header.write(bsOut);
 
     // --- 5. DCT Processing and Encoding ---
 
@@ -121,37 +228,185 @@ int main(int argc, char *argv[]) {
     // Do zero padding, if necessary
     samples.resize(nBlocks * bs * nChannelsOut);
 
+    // Block switching: the flags of the transient detector follow the header
+    vector<bool> shortBlocks(nBlocks, false);
+    if(switching) {
+        shortBlocks = DCTSwitch::detect(samples, bs);
+        DCTSwitch::write(bsOut, shortBlocks);
+        if(verbose) cerr << "Short blocks: " << count(shortBlocks.begin(), shortBlocks.end(), true) << " of " << nBlocks << "\n";
+    }
+
+    // MDCT: frame n covers blocks n - 1 and n, so the signal gets a block of
+    // zeros on each side and there is one more frame than blocks
+    unique_ptr<WAVMdct> mdct;
+    if(header.mdct()) {
+        mdct = make_unique<WAVMdct>(bs, transform == DCTTransform::MDCT_KBD ? MDCTWindow::KBD : MDCTWindow::SINE);
+        samples.insert(samples.begin(), bs, 0);
+        samples.resize(samples.size() + bs, 0);
+        nBlocks = header.blocks();
+        shortBlocks.resize(nBlocks, false);     // (no block switching with the MDCT)
+    }
+
     // Vector for holding DCT computations for the current block
     vector<double> x(bs);
 
     // Direct DCT plan (FFTW_REDFT10 is DCT-II, which is a common choice for this)
     fftw_plan plan_d = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT10, FFTW_ESTIMATE);
 
+    // Short DCT plan, for the blocks with a transient
+    const size_t shortBs = bs / DCTSwitch::SHORT_BLOCKS;
+    const size_t shortCoeffs = nDctCoeffsPerBlock / DCTSwitch::SHORT_BLOCKS;
+    vector<double> xs(max<size_t>(shortBs, 1));
+    fftw_plan plan_s = fftw_plan_r2r_1d(xs.size(), xs.data(), xs.data(), FFTW_REDFT10, FFTW_ESTIMATE);
+
     if(verbose) cerr << "Encoding " << nBlocks << " blocks...\n";
 
+    // Coefficients kept for the entropy coders, which need the whole histogram first
+    vector<long> coefs;
+
+    // Parameters of each block (-target-snr), chosen from the distortion each
+    // step and count would have, and the DCTDistortion weights they use
+    vector<DCTBlockParams> params;
+    vector<double> weight(bs);
+
+    // Estimated distortion of each channel (-snr)
+    vector<DCTDistortion> distortion(nChannelsOut);
+    if(estimateBlocks) cout << fixed << setprecision(4) << left << setw(12) << "Block" << setw(12) << "Channel"
+        << setw(20) << "SNR (dB)" << "MSE" << endl;
+
     for(size_t n = 0 ; n < nBlocks ; n++) {
         for(size_t c = 0 ; c < nChannelsOut ; c++) { // nChannels is 1 (mono)
-            // Copy samples of the current channel/block into the DCT input vector
-            for(size_t k = 0 ; k < bs ; k++)
-                x[k] = samples[(n * bs + k) * nChannelsOut + c];
+            if(mdct) {
+                // MDCT of the frame of 2 * bs samples starting at (padded) block n
+                mdct->forward(samples.data() + n * bs);
+                copy(mdct->data().begin(), mdct->data().end(), x.begin());
+            } else if(shortBlocks[n]) {
+                // SHORT_BLOCKS DCTs, with their coefficients interleaved
+                for(size_t s = 0 ; s < DCTSwitch::SHORT_BLOCKS ; s++) {
+                    for(size_t k = 0 ; k < shortBs ; k++)
+                        xs[k] = samples[(n * bs + s * shortBs + k) * nChannelsOut + c];
+                    fftw_execute(plan_s);
+                    for(size_t k = 0 ; k < shortBs ; k++)
+                        x[k * DCTSwitch::SHORT_BLOCKS + s] = xs[k];
+                }
+            } else {
+                // Copy samples of the current channel/block into the DCT input vector
+                for(size_t k = 0 ; k < bs ; k++)
+                    x[k] = samples[(n * bs + k) * nChannelsOut + c];
+
+                // Execute DCT
+                fftw_execute(plan_d);
+            }
 
-            // Execute DCT
-            fftw_execute(plan_d);
+            for(size_t i = 0 ; i < bs ; i++)
+                weight[i] = shortBlocks[n] ? DCTDistortion::weight(i / DCTSwitch::SHORT_BLOCKS, shortBs, false)
+                                           : DCTDistortion::weight(i, bs, header.mdct());
 
             // --- 7. Quantization and Writing to BitStream ---
 
-            for(size_t k = 0 ; k < nDctCoeffsPerBlock ; k++) {
-                double dct_coeff = x[k];
+            if(adaptive) {
+                // The block's energy lowered by the target SNR is its distortion budget
+                double energy = 0;
+                for(size_t i = 0 ; i < bs ; i++)
+                    energy += weight[i] * x[i] * x[i];
+                params.push_back(DCTTarget::choose(x, weight, energy / pow(10, targetSnr / 10), coder == DCTCoder::RAW));
+                for(size_t k = 0 ; k < params.back().count ; k++)
+                    coefs.push_back(lround(x[k] / params.back().scale()));
+            }
+
+            for(size_t k = 0 ; k < nDctCoeffsPerBlock && not adaptive ; k++) {
+                // (short blocks keep shortCoeffs coefficients each)
+                double dct_coeff = shortBlocks[n] && k >= shortCoeffs * DCTSwitch::SHORT_BLOCKS ? 0.0 : x[k];
 
                 long q_val = lround(dct_coeff);
 
-                bsOut.write_n_bits(static_cast<uint64_t>(q_val), N_BITS_QUANT);
+                if(coder == DCTCoder::RAW)
+                    bsOut.write_n_bits(static_cast<uint64_t>(q_val), N_BITS_QUANT);
+                else
+                    coefs.push_back(q_val);
+            }
+
+            // Distortion from the coefficients: the kept ones have the error of
+            // their quantization, the rest are lost entirely
+            if(estimate) {
+                DCTDistortion block;
+                for(size_t i = 0 ; i < bs ; i++) {
+                    if(adaptive) {
+                        const DCTBlockParams& p = params.back();
+                        block.add(x[i], i < p.count ? lround(x[i] / p.scale()) * p.scale() : 0.0, weight[i]);
+                        continue;
+                    }
+                    bool kept = shortBlocks[n] ? i / DCTSwitch::SHORT_BLOCKS < shortCoeffs : i < nDctCoeffsPerBlock;
+                    long q_val = kept ? lround(x[i]) : 0;
+                    if(coder == DCTCoder::RAW)
+                        q_val = raw_coefficient(q_val, N_BITS_QUANT);
+                    block.add(x[i], static_cast<double>(q_val), weight[i]);
+                }
+                distortion[c].add(block);
+                if(estimateBlocks)
+                    cout << left << setw(12) << n << setw(12) << (c + 1) << setw(20) << block.snr()
+                         << block.mse(bs) << endl;
             }
         }
     }
 
+    // -target-snr: the block parameters, then the RAW coefficients in the
+    // width of their block, or CABAC and EMBEDDED blocks padded to the largest count
+    if(adaptive) {
+        DCTTarget::write(bsOut, params, coder == DCTCoder::RAW);
+        vector<size_t> offset = DCTTarget::offsets(params, 0);
+        if(coder == DCTCoder::RAW) {
+            for(size_t b = 0 ; b < params.size() ; b++)
+                for(size_t i = offset[b] ; i < offset[b + 1] ; i++)
+                    bsOut.write_n_bits(static_cast<uint64_t>(coefs[i]), params[b].bits);
+        } else if(coder == DCTCoder::CABAC || coder == DCTCoder::EMBEDDED) {
+            nDctCoeffsPerBlock = DCTTarget::stride(params);
+            vector<long> padded(params.size() * nDctCoeffsPerBlock, 0);
+            for(size_t b = 0 ; b < params.size() ; b++)
+                copy(coefs.begin() + offset[b], coefs.begin() + offset[b + 1], padded.begin() + b * nDctCoeffsPerBlock);
+            coefs.swap(padded);
+        }
+        if(verbose) cerr << "Target SNR " << targetSnr << " dB: " << offset.back() << " coefficients kept\n";
+    }
+
+    if(coder == DCTCoder::HUFFMAN) {
+        BitPacker packer;
+        DCTCoef::write_huffman(packer, coefs);
+        write_payload(bsOut, packer);
+        if(verbose) cerr << "Huffman payload: " << packer.size() << " bytes\n";
+    } else if(coder == DCTCoder::RANS) {
+        BitPacker packer;
+        DCTCoef::write_rans(packer, coefs);
+        write_payload(bsOut, packer);
+        if(verbose) cerr << "rANS payload: " << packer.size() << " bytes\n";
+    } else if(coder == DCTCoder::CABAC) {
+        BitPacker packer;
+        DCTPlanes::write(packer, coefs, nDctCoeffsPerBlock, nChannelsOut);
+        write_payload(bsOut, packer);
+        if(verbose) cerr << "CABAC payload: " << packer.size() << " bytes\n";
+    } else if(coder == DCTCoder::EMBEDDED) {
+        BitPacker packer;
+        DCTPlanes::write_embedded(packer, coefs, nDctCoeffsPerBlock, nChannelsOut);
+        write_embedded_payload(bsOut, packer);
+        if(verbose) cerr << "Embedded payload: " << packer.size() << " bytes\n";
+    }
+
+    // Same layout as wav_cmp, whose measurements this estimates
+    if(estimate) {
+        cout << fixed << setprecision(4);
+        cout << "Estimated distortion (Parseval, not decoded):\n";
+        cout << "------------------------------------------------------------------" << endl;
+        cout << left << setw(12) << "Channel" << setw(20) << "SNR (dB)" << "MSE" << endl;
+        cout << "------------------------------------------------------------------" << endl;
+        for(size_t c = 0 ; c < nChannelsOut ; c++)
+            cout << left << setw(12) << (c + 1) << setw(20) << distortion[c].snr()
+                 << distortion[c].mse(nFrames) << endl;
+        cout << "------------------------------------------------------------------" << endl;
+    }
+
     // --- 7. Cleanup ---
     fftw_destroy_plan(plan_d);
+    fftw_destroy_plan(plan_s);
 
     if(verbose) cerr << "Closing BitStream...\n";
     bsOut.close();
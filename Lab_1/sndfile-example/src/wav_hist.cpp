@@ -15,32 +15,292 @@
 // IEETA / DETI / University of Aveiro
 //
 #include <iostream>
+#include <iomanip>
 #include <vector>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <filesystem>
+#include <system_error>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
 #include <sndfile.hh>
 #include "wav_hist.h"
+#include "wav_dct.h"
 
 using namespace std;
 
 constexpr size_t FRAMES_BUFFER_SIZE = 65536; // Buffer for reading frames
 
+// Summary of one file of a corpus run
+struct FileSummary {
+    bool ok { false };
+    size_t frames { };
+    double entropy { };
+};
+
+// Histograms every file of "files" on a pool of "nJobs" workers. Each worker
+// claims the next unprocessed file, keeps a private aggregate, and merges it
+// into the corpus histogram once it runs out of files.
+int corpus_hist(const vector<string>& files, int channel, unsigned binShift, size_t nJobs) {
+    vector<size_t> aggregate(size_t { 65536 } >> binShift);
+    vector<FileSummary> summaries(files.size());
+    atomic<size_t> next { 0 };
+    mutex aggregateMutex;
+    mutex errorMutex;
+
+    auto worker = [&]() {
+        vector<size_t> local(aggregate.size());
+        vector<short> samples;
+        size_t f;
+        while((f = next++) < files.size()) {
+            SndfileHandle sndFile { files[f] };
+            string error;
+            if(sndFile.error())
+                error = "invalid input file";
+            else if((sndFile.format() & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV)
+                error = "file is not in WAV format";
+            else if((sndFile.format() & SF_FORMAT_SUBMASK) != SF_FORMAT_PCM_16)
+                error = "file is not in PCM_16 format";
+            else if(channel >= 2 ? sndFile.channels() != 2 : channel >= sndFile.channels())
+                error = "channel not available";
+
+            if(not error.empty()) {
+                lock_guard<mutex> lock { errorMutex };
+                cerr << "Error: " << files[f] << ": " << error << '\n';
+                continue;
+            }
+
+            size_t nFrames;
+            samples.resize(FRAMES_BUFFER_SIZE * sndFile.channels());
+            WAVHist hist { sndFile, binShift };
+            while((nFrames = sndFile.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
+                samples.resize(nFrames * sndFile.channels());
+                hist.update(samples);
+                if(channel == 2)
+                    hist.update_mid(samples);
+                else if(channel == 3)
+                    hist.update_side(samples);
+                summaries[f].frames += nFrames;
+            }
+
+            const vector<size_t>& bins { hist.bins(channel) };
+            for(size_t b = 0 ; b < bins.size() ; b++)
+                local[b] += bins[b];
+            summaries[f].entropy = WAVHist::entropy(bins);
+            summaries[f].ok = true;
+        }
+
+        lock_guard<mutex> lock { aggregateMutex };
+        for(size_t b = 0 ; b < local.size() ; b++)
+            aggregate[b] += local[b];
+    };
+
+    vector<thread> pool;
+    // No more workers than files
+    for(size_t j = 0 ; j < max(min(nJobs, files.size()), size_t { 1 }) ; j++)
+        pool.emplace_back(worker);
+    for(auto& t : pool)
+        t.join();
+
+    // Per-file summaries first, in input order, then the aggregate histogram
+    size_t nOk { };
+    for(size_t f = 0 ; f < files.size() ; f++)
+        if(summaries[f].ok) {
+            cout << "# " << files[f] << '\t' << summaries[f].frames << " frames\t"
+                 << summaries[f].entropy << " bits\n";
+            nOk++;
+        }
+    cout << "# corpus\t" << nOk << " files\t" << WAVHist::entropy(aggregate) << " bits\n";
+
+    for(size_t b = 0 ; b < aggregate.size() ; b++)
+        if(aggregate[b])
+            cout << static_cast<long>(b << binShift) - 32768 << '\t' << aggregate[b] << '\n';
+
+    return nOk == files.size() ? 0 : 1;
+}
+
 int main(int argc, char *argv[]) {
+
+    double windowSec { 0.0 };
+    double hopSec { 0.1 };
+    bool raw { false };
+    int rawRate { 44100 };
+    int rawChannels { 2 };
+    size_t nBins { 65536 };
+    size_t dctBands { 0 };
+    size_t bs { 1024 };
+    size_t nJobs { max(thread::hardware_concurrency(), 1u) };
+
     if(argc < 3) {
-        cerr << "Usage: " << argv[0] << " <input file> <channel>\n";
+        cerr << "Usage: " << argv[0] << " [ -w windowSeconds (sliding window mode) ]\n";
+        cerr << "                [ -hop hopSeconds (def 0.1) ]\n";
+        cerr << "                [ -bins numBins (power of two, def 65536) ]\n";
+        cerr << "                [ -dct numBands (DCT coefficient mode) ]\n";
+        cerr << "                [ -bs blockSize (DCT mode, def 1024) ]\n";
+        cerr << "                [ -raw (headerless PCM_16 input) ]\n";
+        cerr << "                [ -rate sampleRate (raw input, def 44100) ]\n";
+        cerr << "                [ -ch channels (raw input, def 2) ]\n";
+        cerr << "                [ -j numJobs (corpus mode, def all cores) ]\n";
+        cerr << "                <input file | - (stdin) | directory | @listFile> <channel>\n";
         cerr << "Channel options:\n";
         cerr << "  0: Left channel\n";
         cerr << "  1: Right channel\n";
         cerr << "  2: Mid channel (stereo only)\n";
         cerr << "  3: Side channel (stereo only)\n";
+        cerr << "  4: Joint L/R entropies and mutual information (stereo only)\n";
+        cerr << "In sliding window mode, one line is output per hop:\n";
+        cerr << "  <window end (s)> <entropy (bits)> <clipped samples>\n";
+        cerr << "In DCT coefficient mode, each band is output as a \"# band\" line\n";
+        cerr << "with its mean and variance, followed by its histogram\n";
+        cerr << "A directory (all *.wav below it) or @listFile (one path per line)\n";
+        cerr << "outputs one \"#\" summary line per file and the aggregate histogram\n";
+        return 1;
+    }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-w") {
+            windowSec = atof(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-hop") {
+            hopSec = atof(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-bins") {
+            nBins = atoi(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-dct") {
+            dctBands = atoi(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-bs") {
+            bs = atoi(argv[n+1]);
+            break;
+        }
+
+    // Coarse bins are obtained by dropping the low bits of each sample
+    unsigned binShift { 0 };
+    while(binShift < 16 && (size_t { 65536 } >> binShift) > nBins)
+        binShift++;
+    if((size_t { 65536 } >> binShift) != nBins) {
+        cerr << "Error: number of bins must be a power of two between 1 and 65536\n";
         return 1;
     }
 
-    SndfileHandle sndFile { argv[argc-2] };
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-raw") {
+            raw = true;
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-rate") {
+            rawRate = atoi(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-ch") {
+            rawChannels = atoi(argv[n+1]);
+            break;
+        }
+
+    for(int n = 1 ; n < argc ; n++)
+        if(string(argv[n]) == "-j") {
+            int jobs = atoi(argv[n+1]);
+            if(jobs < 1) {
+                cerr << "Error: -j needs at least 1 worker\n";
+                return 1;
+            }
+            nJobs = static_cast<size_t>(jobs);
+            break;
+        }
+
+    // "-" reads from stdin, so the tool can sit at the end of a capture pipeline
+    string fileIn { argv[argc-2] };
+
+    // Corpus mode: a directory, or a list of files given as @listFile. Paths
+    // that cannot be read are reported like the files that fail to open
+    error_code ec;
+    if((fileIn.size() > 1 && fileIn[0] == '@') || filesystem::is_directory(fileIn, ec)) {
+        vector<string> files;
+        bool badPath { false };
+        if(fileIn[0] == '@') {
+            ifstream list { fileIn.substr(1) };
+            if(not list) {
+                cerr << "Error: cannot open file list " << fileIn.substr(1) << '\n';
+                return 1;
+            }
+            for(string line ; getline(list, line) ; )
+                if(not line.empty())
+                    files.push_back(line);
+        } else {
+            filesystem::recursive_directory_iterator it {
+                fileIn, filesystem::directory_options::skip_permission_denied, ec };
+            for( ; not ec && it != filesystem::recursive_directory_iterator() ; it.increment(ec)) {
+                string ext { it->path().extension().string() };
+                transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+                if(ext != ".wav")
+                    continue;
+                error_code fileEc;
+                if(it->is_regular_file(fileEc))
+                    files.push_back(it->path().string());
+                else if(fileEc) {
+                    cerr << "Error: " << it->path().string() << ": " << fileEc.message() << '\n';
+                    badPath = true;
+                }
+            }
+            if(ec) {
+                cerr << "Error: " << fileIn << ": " << ec.message() << '\n';
+                badPath = true;
+            }
+            sort(files.begin(), files.end());
+        }
+
+        int channel { stoi(argv[argc-1]) };
+        if(channel < 0 || channel > 3) {
+            cerr << "Error: corpus mode supports channels 0 to 3\n";
+            return 1;
+        }
+
+        if(windowSec > 0.0 || dctBands || raw) {
+            cerr << "Error: corpus mode cannot be combined with -w, -dct or -raw\n";
+            return 1;
+        }
+
+        if(files.empty()) {
+            cerr << "Error: no WAV files found\n";
+            return 1;
+        }
+
+        int status { corpus_hist(files, channel, binShift, nJobs) };
+        return badPath ? 1 : status;
+    }
+
+    int rawFormat { SF_FORMAT_RAW | SF_FORMAT_PCM_16 };
+    SndfileHandle sndFile { fileIn == "-" ?
+      (raw ? SndfileHandle(fileno(stdin), false, SFM_READ, rawFormat, rawChannels, rawRate) :
+             SndfileHandle(fileno(stdin), false)) :
+      (raw ? SndfileHandle(fileIn, SFM_READ, rawFormat, rawChannels, rawRate) :
+             SndfileHandle(fileIn)) };
     if(sndFile.error()) {
         cerr << "Error: invalid input file\n";
         return 1;
     }
 
-    if((sndFile.format() & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV) {
+    if(not raw && (sndFile.format() & SF_FORMAT_TYPEMASK) != SF_FORMAT_WAV) {
         cerr << "Error: file is not in WAV format\n";
         return 1;
     }
@@ -51,7 +311,7 @@ int main(int argc, char *argv[]) {
     }
 
     int channel { stoi(argv[argc-1]) };
-    if(channel >= sndFile.channels() + 2) {
+    if(channel >= sndFile.channels() + 2 && not (channel == 4 && sndFile.channels() == 2)) {
         cerr << "Error: invalid channel requested\n";
         return 1;
     }
@@ -62,12 +322,101 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    if(channel == 4 && (windowSec > 0.0 || dctBands)) {
+        cerr << "Error: joint L/R histogram is not available in sliding window or DCT mode\n";
+        return 1;
+    }
+
+    if(dctBands && (bs == 0 || dctBands > bs)) {
+        cerr << "Error: number of DCT bands must be between 1 and the block size\n";
+        return 1;
+    }
+
     size_t nFrames;
-    vector<short> samples(FRAMES_BUFFER_SIZE * sndFile.channels());
-    WAVHist hist { sndFile };
+    size_t nChannels { static_cast<size_t>(sndFile.channels()) };
+
+    if(dctBands) {
+        // One block is read at a time; the last one is zero padded, as in wav_dct
+        vector<short> samples(bs * nChannels);
+        WAVDct dct { bs };
+        vector<double>& x { dct.data() };
+        WAVDctHist hist { bs, dctBands, binShift };
+
+        while((nFrames = sndFile.readf(samples.data(), bs))) {
+            fill(samples.begin() + nFrames * nChannels, samples.end(), 0);
+            for(size_t k = 0 ; k < bs ; k++) {
+                const short* frame { &samples[k * nChannels] };
+                if(channel == 2)
+                    x[k] = (frame[0] + frame[1]) / 2;
+                else if(channel == 3)
+                    x[k] = (frame[0] - frame[1]) / 2;
+                else
+                    x[k] = frame[channel];
+            }
+
+            dct.forward();
+            hist.update(x);
+        }
+
+        hist.dump();
+        return 0;
+    }
+
+    if(windowSec > 0.0) {
+        size_t windowFrames { static_cast<size_t>(windowSec * sndFile.samplerate()) };
+        size_t hopFrames { static_cast<size_t>(hopSec * sndFile.samplerate()) };
+        if(windowFrames == 0 || hopFrames == 0) {
+            cerr << "Error: window and hop must span at least one frame\n";
+            return 1;
+        }
+
+        // Only one hop is buffered at a time, never the whole stream
+        vector<short> samples(hopFrames * nChannels);
+        vector<short> values(hopFrames);
+        WAVWindowHist hist { windowFrames, binShift };
+        size_t framesSeen { };
+
+        cout << fixed;
+        while((nFrames = sndFile.readf(samples.data(), hopFrames))) {
+            values.resize(nFrames);
+            for(size_t i = 0 ; i < nFrames ; i++) {
+                const short* frame { &samples[i * nChannels] };
+                if(channel == 2)
+                    values[i] = (frame[0] + frame[1]) / 2;
+                else if(channel == 3)
+                    values[i] = (frame[0] - frame[1]) / 2;
+                else
+                    values[i] = frame[channel];
+            }
+
+            hist.update(values);
+            framesSeen += nFrames;
+
+            cout << setprecision(3) << static_cast<double>(framesSeen) / sndFile.samplerate()
+                 << '\t' << setprecision(4) << hist.entropy()
+                 << '\t' << hist.clipped() << endl;
+        }
+
+        return 0;
+    }
+
+    vector<short> samples(FRAMES_BUFFER_SIZE * nChannels);
+
+    if(channel == 4) {
+        WAVJointHist joint { binShift };
+        while((nFrames = sndFile.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
+            samples.resize(nFrames * nChannels);
+            joint.update(samples);
+        }
+
+        joint.info_dump();
+        return 0;
+    }
+
+    WAVHist hist { sndFile, binShift };
     
     while((nFrames = sndFile.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
-        samples.resize(nFrames * sndFile.channels());
+        samples.resize(nFrames * nChannels);
         hist.update(samples);
         
         if(channel == 2) {
@@ -90,4 +439,3 @@ int main(int argc, char *argv[]) {
 
     return 0;
 }
-
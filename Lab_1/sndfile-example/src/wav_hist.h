@@ -1,26 +1,76 @@
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdint>
 #include <iostream>
+#include <cmath>
+#include <limits>
 #include <sndfile.hh>
 
+// Histogram of 16-bit samples using dense counter arrays. Values are mapped to
+// offset binary and right-shifted by "shift", so with 2^k bins (shift = 16 - k)
+// the counters shrink enough to stay in L1 cache while counting.
 class WAVHist {
   private:
-    std::vector<std::map<short, size_t>> counts;
-    std::vector<std::map<short, size_t>> mid_values;
-    std::vector<std::map<short, size_t>> side_values;
+    unsigned shift { };
+    std::vector<std::vector<size_t>> counts;
+    std::vector<size_t> mid_values;
+    std::vector<size_t> side_values;
+
+    size_t bin(short s) const {
+        return static_cast<size_t>(static_cast<unsigned short>(s) ^ 0x8000) >> shift;
+    }
 
   public:
-    WAVHist(const SndfileHandle& sfh) {
-        counts.resize(sfh.channels());
+    WAVHist(const SndfileHandle& sfh, unsigned shift = 0) : shift { shift } {
+        counts.resize(sfh.channels(), std::vector<size_t>(65536 >> shift));
         // Initialize mid and side vectors
-        mid_values.resize(1);
-        side_values.resize(1);
+        mid_values.resize(65536 >> shift);
+        side_values.resize(65536 >> shift);
+    }
+
+    // Width, in sample values, of each histogram bin
+    size_t bin_width() const {
+        return size_t { 1 } << shift;
+    }
+
+    // Counters of the left (0), right (1), mid (2) or side (3) channel,
+    // following the channel options of wav_hist
+    const std::vector<size_t>& bins(int channel) const {
+        if(channel == 2)
+            return mid_values;
+        if(channel == 3)
+            return side_values;
+        return counts[channel];
+    }
+
+    void dump_bins(const std::vector<size_t>& bins) const {
+        for(size_t b = 0 ; b < bins.size() ; b++)
+            if(bins[b])
+                std::cout << static_cast<long>(b << shift) - 32768 << '\t' << bins[b] << '\n';
+    }
+
+    // Entropy, in bits per sample, of a set of counters
+    static double entropy(const std::vector<size_t>& bins) {
+        size_t total { };
+        double sum_clogc { };
+        for(auto c : bins)
+            if(c) {
+                total += c;
+                sum_clogc += c * std::log2(static_cast<double>(c));
+            }
+
+        return total ? std::log2(static_cast<double>(total)) - sum_clogc / total : 0.0;
     }
 
     void update(const std::vector<short>& samples) {
-        size_t n { };
-        for(auto s : samples)
-            counts[n++ % counts.size()][s]++;
+        size_t nChannels { counts.size() };
+        for(size_t c = 0 ; c < nChannels ; c++) {
+            auto& bins { counts[c] };
+            for(size_t i = c ; i < samples.size() ; i += nChannels)
+                bins[bin(samples[i])]++;
+        }
     }
 
     void update_mid(const std::vector<short>& samples) {
@@ -30,7 +80,7 @@ class WAVHist {
             return;
         }
         for(long unsigned int i = 0; i < samples.size()/2; i++) {
-            mid_values[0][(samples[2*i] + samples[2*i+1]) / 2]++;
+            mid_values[bin((samples[2*i] + samples[2*i+1]) / 2)]++;
         }
     }
 
@@ -41,30 +91,253 @@ class WAVHist {
             return;
         }
         for(long unsigned int i = 0; i < samples.size()/2; i++) {
-            side_values[0][(samples[2*i] - samples[2*i+1]) / 2]++;
+            side_values[bin((samples[2*i] - samples[2*i+1]) / 2)]++;
         }
     }
 
     void dump(const size_t channel) const {
-        for(auto [value, counter] : counts[channel])
-            std::cout << value << '\t' << counter << '\n';
+        dump_bins(counts[channel]);
     }
 
     void mid_dump() const {
-        if(mid_values[0].empty()) {
+        if(std::all_of(mid_values.begin(), mid_values.end(), [](size_t c) { return c == 0; })) {
             std::cerr << "No mid channel data available\n";
             return;
         }
-        for(auto [value, counter] : mid_values[0])
-            std::cout << value << '\t' << counter << '\n';
+        dump_bins(mid_values);
     }
 
     void side_dump() const {
-        if(side_values[0].empty()) {
+        if(std::all_of(side_values.begin(), side_values.end(), [](size_t c) { return c == 0; })) {
             std::cerr << "No side channel data available\n";
             return;
         }
-        for(auto [value, counter] : side_values[0])
-            std::cout << value << '\t' << counter << '\n';
+        dump_bins(side_values);
+    }
+};
+
+// Joint (L, R) histogram of a stereo stream, with both axes binned by the same
+// right shift as WAVHist. Coarse resolutions use a dense array laid out in
+// 16x16 tiles, so that the (strongly correlated) pairs near the diagonal share
+// cache lines; fine resolutions fall back to a hash map keyed by (L, R).
+class WAVJointHist {
+  private:
+    static constexpr size_t MAX_DENSE_BINS = 512;
+
+    unsigned shift { };
+    unsigned tile_bits { };
+    size_t nbins { };
+    std::vector<size_t> cells;
+    std::unordered_map<uint32_t, size_t> sparse;
+
+    size_t bin(short s) const {
+        return static_cast<size_t>(static_cast<unsigned short>(s) ^ 0x8000) >> shift;
+    }
+
+    size_t tiled_index(size_t l, size_t r) const {
+        size_t mask { (size_t { 1 } << tile_bits) - 1 };
+        size_t tiles_per_row { nbins >> tile_bits };
+        return (((l >> tile_bits) * tiles_per_row + (r >> tile_bits)) << (2 * tile_bits)) |
+          ((l & mask) << tile_bits) | (r & mask);
+    }
+
+    template<typename F>
+    void for_each(F f) const {
+        if(dense()) {
+            for(size_t l = 0 ; l < nbins ; l++)
+                for(size_t r = 0 ; r < nbins ; r++)
+                    if(size_t c = cells[tiled_index(l, r)])
+                        f(l, r, c);
+        } else {
+            for(auto [key, c] : sparse)
+                f(key >> 16, key & 0xFFFF, c);
+        }
+    }
+
+  public:
+    WAVJointHist(unsigned shift = 0) : shift { shift }, nbins { size_t { 65536 } >> shift } {
+        while(tile_bits < 4 && (size_t { 2 } << tile_bits) <= nbins)
+            tile_bits++;
+        if(dense())
+            cells.resize(nbins * nbins);
+    }
+
+    bool dense() const {
+        return nbins <= MAX_DENSE_BINS;
+    }
+
+    // Expects interleaved stereo samples: L R L R ...
+    void update(const std::vector<short>& samples) {
+        if(dense()) {
+            for(size_t i = 0 ; i + 1 < samples.size() ; i += 2)
+                cells[tiled_index(bin(samples[i]), bin(samples[i+1]))]++;
+        } else {
+            for(size_t i = 0 ; i + 1 < samples.size() ; i += 2)
+                sparse[static_cast<uint32_t>(bin(samples[i]) << 16 | bin(samples[i+1]))]++;
+        }
+    }
+
+    // Prints H(L), H(R), H(L,R) and the mutual information I(L;R), in bits
+    void info_dump() const {
+        std::vector<size_t> left(nbins), right(nbins);
+        size_t total { };
+        double sum_clogc { };
+        for_each([&](size_t l, size_t r, size_t c) {
+            left[l] += c;
+            right[r] += c;
+            total += c;
+            sum_clogc += c * std::log2(static_cast<double>(c));
+        });
+
+        if(total == 0) {
+            std::cerr << "No joint channel data available\n";
+            return;
+        }
+
+        auto entropy = [total](double s) { return std::log2(static_cast<double>(total)) - s / total; };
+        auto marginal = [](const std::vector<size_t>& m) {
+            double s { };
+            for(auto c : m)
+                if(c)
+                    s += c * std::log2(static_cast<double>(c));
+            return s;
+        };
+
+        double hl { entropy(marginal(left)) };
+        double hr { entropy(marginal(right)) };
+        double hlr { entropy(sum_clogc) };
+        std::cout << "H(L)\t" << hl << '\n';
+        std::cout << "H(R)\t" << hr << '\n';
+        std::cout << "H(L,R)\t" << hlr << '\n';
+        std::cout << "I(L;R)\t" << hl + hr - hlr << '\n';
+    }
+};
+
+// Per-band statistics of block DCT coefficients. The coefficients of each block
+// are split into equal-width frequency bands; every band keeps a histogram of
+// the rounded coefficients (the values wav_dct_enc quantizes), binned by the
+// same right shift as WAVHist, plus running sums for its mean and variance.
+class WAVDctHist {
+  private:
+    unsigned shift { };
+    std::vector<size_t> band_start;
+    std::vector<std::map<long, size_t>> counts;
+    std::vector<double> sum;
+    std::vector<double> sum_sq;
+    std::vector<size_t> n;
+
+  public:
+    WAVDctHist(size_t bs, size_t nBands, unsigned shift = 0) : shift { shift },
+      band_start(nBands + 1), counts(nBands), sum(nBands), sum_sq(nBands), n(nBands) {
+        for(size_t b = 0 ; b <= nBands ; b++)
+            band_start[b] = b * bs / nBands;
+    }
+
+    void update(const std::vector<double>& coeffs) {
+        for(size_t b = 0 ; b < counts.size() ; b++) {
+            auto& bins { counts[b] };
+            for(size_t k = band_start[b] ; k < band_start[b+1] ; k++) {
+                double x { coeffs[k] };
+                bins[std::lround(x) >> shift]++;
+                sum[b] += x;
+                sum_sq[b] += x * x;
+            }
+            n[b] += band_start[b+1] - band_start[b];
+        }
+    }
+
+    // One "#" summary line per band, followed by its (value, count) pairs
+    void dump() const {
+        for(size_t b = 0 ; b < counts.size() ; b++) {
+            double mean { n[b] ? sum[b] / n[b] : 0.0 };
+            double var { n[b] ? sum_sq[b] / n[b] - mean * mean : 0.0 };
+            std::cout << "# band " << b << " k " << band_start[b] << '-' << band_start[b+1] - 1
+                      << " mean " << mean << " variance " << var << '\n';
+            for(auto [value, counter] : counts[b])
+                std::cout << value * (long { 1 } << shift) << '\t' << counter << '\n';
+        }
+    }
+};
+
+// Histogram over the last "window" values of a stream. Each new value evicts
+// the oldest one, so updating costs O(block) regardless of the window length.
+// Values are binned by the same right shift as WAVHist. The entropy is kept
+// incrementally through the sum of c*log2(c) over all bins.
+class WAVWindowHist {
+  private:
+    unsigned shift { };
+    std::vector<size_t> counts;     // One bin per 2^shift consecutive 16-bit values
+    std::vector<short> ring;        // Values currently inside the window
+    std::vector<double> dclogc;     // dclogc[c] = (c+1)log2(c+1) - c*log2(c)
+    size_t head { };
+    size_t fill { };
+    size_t nClipped { };
+    size_t sinceResync { };
+    double sum_clogc { };
+
+    size_t bin(short s) const {
+        return static_cast<size_t>(static_cast<unsigned short>(s) ^ 0x8000) >> shift;
+    }
+
+    static bool is_clipped(short s) {
+        return s == std::numeric_limits<short>::min() || s == std::numeric_limits<short>::max();
+    }
+
+    void resync() {
+        // Recompute the running sum from scratch to discard rounding drift
+        sum_clogc = 0;
+        for(auto c : counts)
+            if(c > 1)
+                sum_clogc += c * std::log2(static_cast<double>(c));
+    }
+
+  public:
+    WAVWindowHist(size_t window_size, unsigned shift = 0) : shift { shift },
+      counts(65536 >> shift), ring(window_size), dclogc(window_size + 1) {
+        for(size_t c = 0 ; c <= window_size ; c++)
+            dclogc[c] = (c + 1) * std::log2(c + 1.0) - (c ? c * std::log2(static_cast<double>(c)) : 0.0);
+    }
+
+    void update(const std::vector<short>& values) {
+        // A full rescan costs one pass over the bins, so it is only done once
+        // that many values, and at least a full window, have gone by
+        const size_t resyncPeriod { std::max(ring.size(), counts.size()) };
+        for(auto v : values) {
+            if(fill == ring.size()) {
+                short old { ring[head] };
+                sum_clogc -= dclogc[--counts[bin(old)]];
+                nClipped -= is_clipped(old);
+            }
+            else
+                fill++;
+
+            sum_clogc += dclogc[counts[bin(v)]++];
+            nClipped += is_clipped(v);
+            ring[head] = v;
+            if(++head == ring.size())
+                head = 0;
+            if(++sinceResync == resyncPeriod) {
+                sinceResync = 0;
+                resync();
+            }
+        }
+    }
+
+    // Entropy, in bits per sample, of the values inside the window
+    double entropy() const {
+        if(fill == 0)
+            return 0.0;
+
+        // Clamped, as the drift left between resyncs may push it just below 0
+        return std::max(0.0, std::log2(static_cast<double>(fill)) - sum_clogc / fill);
+    }
+
+    // Number of values inside the window sitting at either full-scale limit
+    size_t clipped() const {
+        return nClipped;
+    }
+
+    size_t size() const {
+        return fill;
     }
 };
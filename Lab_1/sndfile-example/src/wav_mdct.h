@@ -0,0 +1,107 @@
+#ifndef WAVMDCT_H
+#define WAVMDCT_H
+
+#include <vector>
+#include <cmath>
+#include <fftw3.h>
+
+enum class MDCTWindow { SINE, KBD };
+
+// MDCT with a hop of "bs" samples: each frame of 2 * bs samples is windowed,
+// folded into bs values and transformed with an in-place DCT-IV plan
+// (FFTW_REDFT11). The inverse unfolds the DCT-IV output and windows it again;
+// the windows satisfy w[n]^2 + w[n + bs]^2 = 1, so overlap-adding consecutive
+// frames cancels the time-domain aliasing (TDAC). As with WAVDct, FFTW's
+// transforms are not normalised: the overlap-added output is 2 * bs times the input.
+class WAVMdct {
+  private:
+    size_t bs;
+    std::vector<double> x;
+    std::vector<double> w;
+    fftw_plan plan;
+
+    // Zeroth order modified Bessel function of the first kind (power series)
+    static double bessel_i0(double v) {
+        double sum = 1, term = 1;
+        for(int k = 1 ; term > 1e-12 * sum ; k++) {
+            term *= (v / (2 * k)) * (v / (2 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+  public:
+    // Window of 2 * bs samples; KBD uses the Kaiser parameter "alpha"
+    static std::vector<double> window(size_t bs, MDCTWindow type, double alpha = 4) {
+        std::vector<double> w(2 * bs);
+        if(type == MDCTWindow::SINE) {
+            for(size_t n = 0 ; n < 2 * bs ; n++)
+                w[n] = sin(M_PI * (n + 0.5) / (2 * bs));
+            return w;
+        }
+
+        // Kaiser-Bessel derived: square root of the running sum of a Kaiser
+        // window of bs + 1 points, normalised by its total
+        std::vector<double> kaiser(bs + 1);
+        double total = 0;
+        for(size_t j = 0 ; j <= bs ; j++) {
+            double r = 2.0 * j / bs - 1;
+            total += kaiser[j] = bessel_i0(M_PI * alpha * sqrt(1 - r * r));
+        }
+        double sum = 0;
+        for(size_t n = 0 ; n < bs ; n++) {
+            sum += kaiser[n];
+            w[n] = w[2 * bs - 1 - n] = sqrt(sum / total);
+        }
+        return w;
+    }
+
+    WAVMdct(size_t bs, MDCTWindow type) : bs { bs }, x(bs), w { window(bs, type) } {
+        plan = fftw_plan_r2r_1d(bs, x.data(), x.data(), FFTW_REDFT11, FFTW_ESTIMATE);
+    }
+
+    ~WAVMdct() {
+        fftw_destroy_plan(plan);
+    }
+
+    WAVMdct(const WAVMdct&) = delete;
+    WAVMdct& operator=(const WAVMdct&) = delete;
+
+    size_t size() const {
+        return bs;
+    }
+
+    // The bs coefficients after forward(), or the input of inverse_add()
+    std::vector<double>& data() {
+        return x;
+    }
+
+    // Transforms the 2 * bs samples at "frame". With the windowed frame split in
+    // quarters (a, b, c, d), the DCT-IV input is (-c_r - d, a - b_r), where _r
+    // denotes reversal.
+    template<typename Sample>
+    void forward(const Sample* frame) {
+        const size_t h = bs / 2;
+        auto z = [&](size_t i) { return w[i] * frame[i]; };
+        for(size_t n = 0 ; n < h ; n++) {
+            x[n] = -z(bs + h - 1 - n) - z(bs + h + n);
+            x[h + n] = z(n) - z(bs - 1 - n);
+        }
+        fftw_execute(plan);
+    }
+
+    // Inverse of the coefficients in data(); the windowed 2 * bs samples are
+    // added to "out". The DCT-IV output (u1, u2) unfolds to (u2, -u2_r, -u1_r, -u1).
+    void inverse_add(double* out) {
+        fftw_execute(plan);
+        const size_t h = bs / 2;
+        for(size_t n = 0 ; n < h ; n++) {
+            out[n] += w[n] * x[h + n];
+            out[h + n] -= w[h + n] * x[bs - 1 - n];
+            out[bs + n] -= w[bs + n] * x[h - 1 - n];
+            out[bs + h + n] -= w[bs + h + n] * x[n];
+        }
+    }
+};
+
+#endif
@@ -1,7 +1,11 @@
 #include <iostream>
 #include <vector>
+#include <fstream>
+#include <optional>
 #include <sndfile.hh>
 #include "wav_quant.h"
+#include "bit_pack.h"
+#include "wq01.h"
 
 using namespace std;
 
@@ -9,11 +13,39 @@ constexpr size_t FRAMES_BUFFER_SIZE = 65536; // Buffer for reading frames
 
 int main(int argc, char *argv[]) {
 
+	QuantMode mode { QuantMode::TRUNCATE };
+	bool useLut { false };
+	bool pack { false };
+
 	if(argc < 4) {
-		cerr << "Usage: " << argv[0] << " <input file> <bits_to_keep> <output_file>\n";
+		cerr << "Usage: " << argv[0] << " [ -mode trunc|midtread|midrise|lloyd (def trunc) ]\n";
+		cerr << "                 [ -lut (table-driven quantization) ]\n";
+		cerr << "                 [ -pack (write a packed WQ01 archive, as wav_quant_enc) ]\n";
+		cerr << "                 <input file> <bits_to_keep> <output_file>\n";
 		return 1;
 	}
 
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-mode") {
+			if(not parse_quant_mode(argv[n+1], mode)) {
+				cerr << "Error: unknown quantization mode " << argv[n+1] << '\n';
+				return 1;
+			}
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-lut") {
+			useLut = true;
+			break;
+		}
+
+	for(int n = 1 ; n < argc ; n++)
+		if(string(argv[n]) == "-pack") {
+			pack = true;
+			break;
+		}
+
 	SndfileHandle sfhIn { argv[argc-3] };
 	if(sfhIn.error()) {
 		cerr << "Error: invalid input file\n";
@@ -31,29 +63,89 @@ int main(int argc, char *argv[]) {
         return 1;
     } 
 
-    size_t bits_to_keep { stoi(argv[argc-2]) };
-    if(bits_to_keep >= 16) {
-        cerr << "Error: bits_to_keep must be less than 16\n";
+    int bits_to_keep { stoi(argv[argc-2]) };
+    if(bits_to_keep < 1 || bits_to_keep >= 16) {
+        cerr << "Error: bits_to_keep must be between 1 and 15\n";
         return 1;
     } 
 
-    size_t bits_to_cut { 16 - bits_to_keep };   
+    size_t bits_to_cut { 16 - static_cast<size_t>(bits_to_keep) };   
+    size_t nFrames;
+    size_t nChannels { static_cast<size_t>(sfhIn.channels()) };
+    vector<short> samples(FRAMES_BUFFER_SIZE * nChannels);
+
+    optional<LloydMaxQuantizer> lloyd;
+    if(mode == QuantMode::LLOYD_MAX) {
+        // First pass: histogram of all samples, to train the codebook on
+        vector<size_t> hist(65536);
+        while((nFrames = sfhIn.readf(samples.data(), FRAMES_BUFFER_SIZE)))
+            for(size_t i = 0 ; i < nFrames * nChannels ; i++)
+                hist[samples[i] + 32768]++;
+
+        lloyd = LloydMaxQuantizer::train(hist, bits_to_keep);
+
+        // The second pass quantizes through the 65536-entry index table
+        sfhIn = SndfileHandle { argv[argc-3] };
+    }
+
+    if(pack) {
+        ofstream ofs { argv[argc-1], ios::binary };
+        if(not ofs) {
+            cerr << "Error: invalid output file\n";
+            return 1;
+        }
+
+        WQ01Header header;
+        header.sample_rate = sfhIn.samplerate();
+        header.num_channels = sfhIn.channels();
+        header.quant_bits = bits_to_keep;
+        header.mode = mode;
+        header.num_frames = sfhIn.frames();
+        if(lloyd)
+            header.codebook = lloyd->codebook();
+        header.write(ofs);
+
+        // Quantize and pack each block in a single pass over the samples
+        UniformQuantizer uniform { mode, bits_to_keep, useLut };
+        BitPacker packer;
+        while((nFrames = sfhIn.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
+            if(lloyd)
+                packer.quant_pack(*lloyd, samples.data(), nFrames * nChannels, bits_to_keep);
+            else
+                packer.quant_pack(uniform, samples.data(), nFrames * nChannels, bits_to_keep);
+
+            ofs.write(reinterpret_cast<const char*>(packer.data()), packer.size());
+            packer.clear();
+        }
+
+        packer.finish();
+        ofs.write(reinterpret_cast<const char*>(packer.data()), packer.size());
+        return 0;
+    }
+
     SndfileHandle sfhOut { argv[argc-1], SFM_WRITE, sfhIn.format(), sfhIn.channels(), sfhIn.samplerate() };
     if(sfhOut.error()) {
         cerr << "Error: invalid output file\n";
         return 1;
     }
 
-    size_t nFrames;
-    vector<short> samples(FRAMES_BUFFER_SIZE * sfhIn.channels());
-    WAVQuant quant;
+    WAVQuant quant { mode };
+    optional<UniformQuantizer> lutQuant;
+    if(useLut)
+        lutQuant.emplace(mode, bits_to_keep, true);
     
     // Read and process all frames
     while((nFrames = sfhIn.readf(samples.data(), FRAMES_BUFFER_SIZE))) {
-        quant.quant(samples, bits_to_cut);
+        // Only the frames actually read hold valid samples
+        if(lloyd)
+            lloyd->quant(samples.data(), nFrames * nChannels);
+        else if(lutQuant)
+            lutQuant->quant(samples.data(), nFrames * nChannels);
+        else
+            quant.quant(samples.data(), nFrames * nChannels, bits_to_cut);
         
         sfhOut.writef(samples.data(), nFrames);
     }
     
     return 0;
-}
\ No newline at end of file
+}
@@ -5,16 +5,105 @@
 #include <vector>
 #include <map>
 #include <sndfile.hh>
+#include "quantizer.h"
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVQUANT_X86
+#endif
+
+// In-place uniform quantizer that drops the "num_bits" least significant bits
+// of each sample. Every mode of UniformQuantizer reduces to
+// (sat16(s + pre) & mask) + post, which the SIMD kernels below apply to 8 (SSE2),
+// 16 (AVX2) or 32 (AVX-512) samples at a time. The widest kernel supported by
+// the running CPU is selected once, at construction.
 class WAVQuant {
-public:
-    WAVQuant() {}
+  private:
+    using Kernel = void (*)(short*, size_t, short, short, short);
+    QuantMode mode;
+    Kernel kernel;
+    size_t bits { 0 };      // num_bits of pre, mask and post (the defaults are those of 0)
+    short pre { 0 }, mask { -1 }, post { 0 };
 
-    void quant(std::vector<short>& samples, size_t num_bits) {
-        for (auto& sample : samples) {
-            sample = (sample >> num_bits) << num_bits;
+    static void quant_scalar(short* samples, size_t n, short pre, short mask, short post) {
+        for(size_t i = 0 ; i < n ; i++) {
+            int v { std::min(samples[i] + pre, 32767) };
+            samples[i] = static_cast<short>((v & mask) + post);
+        }
+    }
+
+#ifdef WAVQUANT_X86
+    __attribute__((target("sse2")))
+    static void quant_sse2(short* samples, size_t n, short pre, short mask, short post) {
+        const __m128i a { _mm_set1_epi16(pre) };
+        const __m128i m { _mm_set1_epi16(mask) };
+        const __m128i b { _mm_set1_epi16(post) };
+        size_t i { 0 };
+        for( ; i + 8 <= n ; i += 8) {
+            __m128i* p { reinterpret_cast<__m128i*>(samples + i) };
+            __m128i v { _mm_adds_epi16(_mm_loadu_si128(p), a) };
+            _mm_storeu_si128(p, _mm_add_epi16(_mm_and_si128(v, m), b));
         }
+        quant_scalar(samples + i, n - i, pre, mask, post);
+    }
+
+    __attribute__((target("avx2")))
+    static void quant_avx2(short* samples, size_t n, short pre, short mask, short post) {
+        const __m256i a { _mm256_set1_epi16(pre) };
+        const __m256i m { _mm256_set1_epi16(mask) };
+        const __m256i b { _mm256_set1_epi16(post) };
+        size_t i { 0 };
+        for( ; i + 16 <= n ; i += 16) {
+            __m256i* p { reinterpret_cast<__m256i*>(samples + i) };
+            __m256i v { _mm256_adds_epi16(_mm256_loadu_si256(p), a) };
+            _mm256_storeu_si256(p, _mm256_add_epi16(_mm256_and_si256(v, m), b));
+        }
+        quant_scalar(samples + i, n - i, pre, mask, post);
+    }
+
+    __attribute__((target("avx512bw")))
+    static void quant_avx512(short* samples, size_t n, short pre, short mask, short post) {
+        const __m512i a { _mm512_set1_epi16(pre) };
+        const __m512i m { _mm512_set1_epi16(mask) };
+        const __m512i b { _mm512_set1_epi16(post) };
+        size_t i { 0 };
+        for( ; i + 32 <= n ; i += 32) {
+            void* p { samples + i };
+            __m512i v { _mm512_adds_epi16(_mm512_loadu_si512(p), a) };
+            _mm512_storeu_si512(p, _mm512_add_epi16(_mm512_and_si512(v, m), b));
+        }
+        quant_scalar(samples + i, n - i, pre, mask, post);
+    }
+#endif
+
+  public:
+    WAVQuant(QuantMode mode = QuantMode::TRUNCATE) : mode { mode }, kernel { quant_scalar } {
+#ifdef WAVQUANT_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512bw"))
+            kernel = quant_avx512;
+        else if(__builtin_cpu_supports("avx2"))
+            kernel = quant_avx2;
+        else if(__builtin_cpu_supports("sse2"))
+            kernel = quant_sse2;
+#endif
+    }
+
+    // Quantizes only the first "n" samples (e.g., the frames returned by readf)
+    void quant(short* samples, size_t n, size_t num_bits) {
+        if(num_bits != bits) {
+            int keep { 16 - static_cast<int>(num_bits) };
+            pre = UniformQuantizer::pre_offset(mode, keep);
+            mask = UniformQuantizer::mask(keep);
+            post = UniformQuantizer::post_offset(mode, keep);
+            bits = num_bits;
+        }
+        kernel(samples, n, pre, mask, post);
+    }
+
+    void quant(std::vector<short>& samples, size_t num_bits) {
+        quant(samples.data(), samples.size(), num_bits);
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,203 @@
+#ifndef WQ01_H
+#define WQ01_H
+
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "quantizer.h"
+#include "bit_pack.h"
+
+// Entropy coding of the indices (bits 1-2 of the extension byte)
+enum class WQ01Coder : uint8_t { FIXED = 0, HUFFMAN = 1, RANS = 2 };
+
+// Header of the WQ01 quantized format (little-endian, 15 bytes):
+//   "WQ01" | sample rate (4) | channels (2) | ext << 7 | mode << 5 | quant_bits (1) | frames (4)
+// With ext set, an extension byte follows (bit 0: block mode, bits 1-2: WQ01Coder)
+// and then, in block mode, the frames per block (2). In LLOYD_MAX mode the
+// 2^quant_bits codebook levels (int16 each) come next. The payload is either the
+// MSB-first packed quant_bits-wide indices of all samples, interleaved by
+// channel, a sequence of WQ01Block records (block mode), a Huffman code
+// table followed by the Huffman codes of the indices, or a rANS stream of the
+// indices (RANSCode::write_stream).
+struct WQ01Header {
+	static constexpr size_t FIXED_SIZE = 15;
+
+	uint32_t				sample_rate { };
+	uint16_t				num_channels { };
+	uint8_t					quant_bits { };
+	QuantMode				mode { QuantMode::MID_RISE };
+	uint32_t				num_frames { };
+	uint16_t				block_frames { };	// 0 = a single fixed width for the whole file
+	WQ01Coder				coder { WQ01Coder::FIXED };
+	std::vector<int16_t>	codebook;
+
+	bool extended() const {
+		return block_frames || coder != WQ01Coder::FIXED;
+	}
+
+	size_t size() const {
+		return FIXED_SIZE + (extended() ? 1 : 0) + (block_frames ? 2 : 0) + codebook.size() * sizeof(int16_t);
+	}
+
+	size_t block_samples() const {
+		return static_cast<size_t>(block_frames) * num_channels;
+	}
+
+	size_t total_samples() const {
+		return static_cast<size_t>(num_frames) * num_channels;
+	}
+
+	// Size of the packed indices (fixed-width mode only)
+	size_t payload_size() const {
+		return (total_samples() * quant_bits + 7) / 8;
+	}
+
+	void write(std::ostream& os) const {
+		uint8_t qbits = static_cast<uint8_t>(quant_bits | (static_cast<int>(mode) << 5) | (extended() ? 0x80 : 0));
+		os.write("WQ01", 4);
+		os.write(reinterpret_cast<const char*>(&sample_rate), 4);
+		os.write(reinterpret_cast<const char*>(&num_channels), 2);
+		os.write(reinterpret_cast<const char*>(&qbits), 1);
+		os.write(reinterpret_cast<const char*>(&num_frames), 4);
+		if(extended()) {
+			uint8_t ext = static_cast<uint8_t>((block_frames ? 1 : 0) | (static_cast<int>(coder) << 1));
+			os.write(reinterpret_cast<const char*>(&ext), 1);
+		}
+		if(block_frames)
+			os.write(reinterpret_cast<const char*>(&block_frames), 2);
+		os.write(reinterpret_cast<const char*>(codebook.data()), codebook.size() * sizeof(int16_t));
+	}
+
+	// Returns false, with a message in "error", if the header is not valid
+	bool read(std::istream& is, std::string& error) {
+		char magic[4] { };
+		uint8_t qbits { };
+		is.read(magic, 4);
+		is.read(reinterpret_cast<char*>(&sample_rate), 4);
+		is.read(reinterpret_cast<char*>(&num_channels), 2);
+		is.read(reinterpret_cast<char*>(&qbits), 1);
+		is.read(reinterpret_cast<char*>(&num_frames), 4);
+		if(not is) {
+			error = "file too small to be valid (needs at least 15 bytes for header)";
+			return false;
+		}
+
+		if(std::string(magic, 4) != "WQ01") {
+			error = "invalid file format (expected WQ01, got " + std::string(magic, 4) + ")";
+			return false;
+		}
+
+		// Bits 5-6 select the quantizer (0 = mid-rise, as in files written before modes existed)
+		quant_bits = qbits & 0x1F;
+		mode = static_cast<QuantMode>((qbits >> 5) & 0x3);
+		if(quant_bits == 0 || quant_bits > 16) {
+			error = "invalid quantization bits: " + std::to_string(quant_bits);
+			return false;
+		}
+
+		block_frames = 0;
+		coder = WQ01Coder::FIXED;
+		if(qbits & 0x80) {
+			uint8_t ext { };
+			is.read(reinterpret_cast<char*>(&ext), 1);
+			coder = static_cast<WQ01Coder>((ext >> 1) & 0x3);
+			if(not is || coder > WQ01Coder::RANS) {
+				error = "invalid header extension";
+				return false;
+			}
+			if(ext & 1) {
+				is.read(reinterpret_cast<char*>(&block_frames), 2);
+				if(not is || block_frames == 0) {
+					error = "invalid block size";
+					return false;
+				}
+			}
+		}
+
+		codebook.clear();
+		if(mode == QuantMode::LLOYD_MAX) {
+			codebook.resize(size_t { 1 } << quant_bits);
+			is.read(reinterpret_cast<char*>(codebook.data()), codebook.size() * sizeof(int16_t));
+			if(not is) {
+				error = "file too small to hold the Lloyd-Max codebook";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	// Index -> sample table for the decoder
+	std::vector<int16_t> reconstruction_table() const {
+		if(mode == QuantMode::LLOYD_MAX)
+			return codebook;
+
+		UniformQuantizer q { mode, quant_bits };
+		std::vector<int16_t> table(q.levels());
+		for(int i = 0 ; i < q.levels() ; i++)
+			table[i] = q.reconstruct(static_cast<uint16_t>(i));
+		return table;
+	}
+};
+
+// Block record of the WQ01 block mode: one byte with the width w, followed by
+// the indices of the block as w-bit two's complement offsets from the middle
+// level 2^(quant_bits-1), padded to a whole byte. The width is the smallest
+// one that holds the block peak, so quiet blocks take fewer bits while the
+// quantization step stays the same; w = 0 means every index is the middle one.
+// Records start on byte boundaries, so their offsets follow from the widths alone.
+struct WQ01Block {
+	// Smallest width holding every index of the block
+	static int width(const uint16_t* indices, size_t n, int bits) {
+		const int half = 1 << (bits - 1);
+		int lo = 0, hi = 0;
+		for(size_t i = 0 ; i < n ; i++) {
+			lo = std::min(lo, indices[i] - half);
+			hi = std::max(hi, indices[i] - half);
+		}
+		int w = 0;
+		while(w == 0 ? (lo != 0 || hi != 0) : (lo < -(1 << (w - 1)) || hi >= (1 << (w - 1))))
+			w++;
+		return w;
+	}
+
+	// Bytes of a record of "n" indices of width "w"
+	static size_t size(size_t n, int w) {
+		return 1 + (n * w + 7) / 8;
+	}
+
+	// Appends the record for "n" indices to "packer" (the indices are overwritten)
+	static void pack(BitPacker& packer, uint16_t* indices, size_t n, int bits) {
+		const int w = width(indices, n, bits);
+		const uint16_t half = static_cast<uint16_t>(1 << (bits - 1));
+		const uint16_t mask = static_cast<uint16_t>((1u << w) - 1);
+		const uint16_t header = static_cast<uint16_t>(w);
+		packer.pack(&header, 1, 8);
+		if(w > 0) {
+			for(size_t i = 0 ; i < n ; i++)
+				indices[i] = static_cast<uint16_t>(indices[i] - half) & mask;
+			packer.pack(indices, n, w);
+		}
+		packer.finish();
+	}
+
+	// Decodes the record at "data" (which must hold size(n, data[0]) bytes)
+	// into "n" indices
+	static void unpack(const uint8_t* data, size_t n, int bits, uint16_t* indices) {
+		const int w = data[0];
+		const uint16_t half = static_cast<uint16_t>(1 << (bits - 1));
+		if(w == 0) {
+			std::fill(indices, indices + n, half);
+			return;
+		}
+		BitUnpacker unpacker(data + 1, size(n, w) - 1);
+		unpacker.unpack(indices, n, w);
+		const uint16_t sign = static_cast<uint16_t>(1 << (w - 1));
+		for(size_t i = 0 ; i < n ; i++)
+			indices[i] = static_cast<uint16_t>((indices[i] ^ sign) - sign + half);
+	}
+};
+
+#endif